@@ -0,0 +1,141 @@
+#ifndef BUS_H
+#define BUS_H
+
+#include <stdio.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+using namespace std;
+
+// Snooping bus as a shared resource
+//
+// Every bus transaction holds the bus for its occupancy. A request that
+// finds it busy waits, and that queueing delay is charged to the requesting
+// core. Requests are resolved as they are issued (in cycle order, by the
+// event engine); the transactions granted but not started yet at the
+// latest request stay queued so that arbitration can still reorder them:
+//
+//   fcfs         a request goes behind everything already queued
+//   round-robin  a request goes ahead of queued requests of cores that come
+//                after it in the rotation from the previous grant, and the
+//                transactions it overtakes start later (their cores are
+//                charged the extra wait)
+
+typedef enum
+{
+    ArbitrationFCFS,
+    ArbitrationRR
+} arbitration_t;
+
+typedef struct {
+    int  core;
+    long arrival;           // Cycle of the request
+    long start;             // Cycle the bus is granted
+    long occupancy;
+} bus_slot_t;
+
+// Extra wait charged to a core whose queued transaction was overtaken
+typedef struct {
+    int  core;
+    long cycles;
+} bus_push_t;
+
+typedef struct {
+    arbitration_t arbitration;
+    int  num_cores;
+    deque<bus_slot_t> queued;   // Granted in this order, not started yet
+    long free_at;               // End of the latest started transaction
+    int  last_core;             // Core of the latest started transaction
+    vector<bus_push_t> pushed;  // Filled by busRequest
+
+    long transactions;
+    long busy_cycles;           // Sum of occupancies
+    long wait_cycles;           // Sum of queueing delays
+    long max_wait;
+    long last_end;              // End of the latest transaction
+} bus_t;
+
+inline void busInit(bus_t *bus, arbitration_t arbitration, int num_cores) {
+    bus->arbitration = arbitration;
+    bus->num_cores = num_cores;
+    bus->queued.clear();
+    bus->free_at = 0;
+    bus->last_core = num_cores - 1;
+    bus->pushed.clear();
+    bus->transactions = 0;
+    bus->busy_cycles = 0;
+    bus->wait_cycles = 0;
+    bus->max_wait = 0;
+    bus->last_end = 0;
+}
+
+// Whether core a is granted before core b after core last
+static inline int busRotationBefore(const bus_t *bus, int a, int b, int last) {
+    int n = bus->num_cores;
+    return (a - last - 1 + n) % n < (b - last - 1 + n) % n;
+}
+
+// Request the bus for occupancy cycles at cycle arrival, returns the
+// queueing delay of the request. Transactions it pushed back are listed in
+// bus->pushed for the caller to charge.
+inline long busRequest(bus_t *bus, int core, long arrival, long occupancy) {
+    bus->pushed.clear();
+
+    // Transactions that started by now can no longer be reordered
+    while (!bus->queued.empty() && bus->queued.front().start <= arrival) {
+        const bus_slot_t &s = bus->queued.front();
+        bus->free_at = s.start + s.occupancy;
+        bus->last_core = s.core;
+        bus->queued.pop_front();
+    }
+
+    size_t k = bus->queued.size();
+    if (bus->arbitration == ArbitrationRR) {
+        // Never ahead of the core's own earlier transactions
+        size_t from = 0;
+        for (size_t j = 0; j < bus->queued.size(); j++) {
+            if (bus->queued[j].core == core) from = j + 1;
+        }
+        int last = from == 0 ? bus->last_core : bus->queued[from - 1].core;
+        for (k = from; k < bus->queued.size(); k++) {
+            if (busRotationBefore(bus, core, bus->queued[k].core, last)) break;
+            last = bus->queued[k].core;
+        }
+    }
+
+    long end = k == 0 ? bus->free_at : bus->queued[k - 1].start + bus->queued[k - 1].occupancy;
+    bus_slot_t slot = {core, arrival, max(arrival, end), occupancy};
+    bus->queued.insert(bus->queued.begin() + k, slot);
+
+    // Later transactions start once this one is done
+    end = slot.start + occupancy;
+    for (size_t j = k + 1; j < bus->queued.size(); j++) {
+        bus_slot_t &s = bus->queued[j];
+        long start = max(s.arrival, end);
+        if (start > s.start) {
+            bus_push_t push = {s.core, start - s.start};
+            bus->pushed.push_back(push);
+            bus->wait_cycles += start - s.start;
+            s.start = start;
+        }
+        end = s.start + s.occupancy;
+    }
+
+    long wait = slot.start - arrival;
+    bus->transactions += 1;
+    bus->busy_cycles += occupancy;
+    bus->wait_cycles += wait;
+    if (wait > bus->max_wait) bus->max_wait = wait;
+    if (end > bus->last_end) bus->last_end = end;
+    return wait;
+}
+
+inline void busPrintStats(const bus_t *bus) {
+    printf("Bus Transactions: %ld\n", bus->transactions);
+    printf("Bus Utilization: %.2f%%\n",
+           bus->last_end ? 100.0 * bus->busy_cycles / bus->last_end : 0.0);
+    printf("Bus Wait Cycles: %ld (%.2f per transaction, max %ld)\n\n", bus->wait_cycles,
+           bus->transactions ? (double)bus->wait_cycles / bus->transactions : 0.0, bus->max_wait);
+}
+
+#endif
@@ -2,20 +2,28 @@
 #include <stdlib.h>
 #include <string.h>
 #include <vector>
-#include <deque>
 #include <cstring>
 #include <sstream>
-#include <tgmath.h> 
+#include <getopt.h>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <unordered_set>
+#include <atomic>
+#include <type_traits>
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+#include "config.h"
+#include "directory.h"
+#include "hierarchy.h"
+#include "parallel.h"
+#include "stats.h"
+#include "sweep.h"
+#include "task.h"
+#include "trace.h"
 using namespace std;
 
-// Struct containing info for each thread
-typedef struct ThreadInfo{
-  int thread_id;
-  long instr_count;
-  deque<long> read_list;
-  deque<long> write_list;
-} threadinfo_t;
-
 // ENUM for Cache Coherence Bus Operations
 typedef enum
 {
@@ -24,302 +32,792 @@ typedef enum
     Flush
 } bus_op_t;
 
-// Cache Parameters
-#define L1_DCACHE_SIZE     32768
-#define L1_DCACHE_ASSOC    8
-#define L1_DCACHE_LINESIZE 64
-#define L1_DCACHE_SETS     (L1_DCACHE_SIZE / L1_DCACHE_ASSOC) / L1_DCACHE_LINESIZE
+// Tags of a set are stored in whole host cache lines of TAGS_PER_BLOCK ways;
+// a set's way count is padded up to a multiple of it (its way_stride)
+#define TAGS_PER_BLOCK 8
 
-#define L2_CACHE_SIZE     262144
-#define L2_CACHE_ASSOC    4
-#define L2_CACHE_LINESIZE 64
-#define L2_CACHE_SETS     (L2_CACHE_SIZE / L2_CACHE_ASSOC) / L2_CACHE_LINESIZE
+typedef struct alignas(64) {
+    uint64_t tag[TAGS_PER_BLOCK];
+} tag_block_t;
 
-#define NUM_CORES         8
+// Tag stored in invalid (and padding) ways
+// Decoded tags are at most 63 bits wide, so this never matches an address.
+#define INVALID_TAG (~(uint64_t)0)
 
-// Estimate
-#define L1_MISS_PENALTY   10
+// log2 of a power of two
+constexpr int log2Exact(long v) {
+    return v <= 1 ? 0 : 1 + log2Exact(v >> 1);
+}
 
-// Cache Structures
-typedef struct {
-    long tag[L1_DCACHE_ASSOC];      /* tag for the line */
-    long opCount[L1_DCACHE_ASSOC];  /* latest operation which used the line */
-    int  state[L1_DCACHE_ASSOC];    /* Cache Coherence State*/
-} L1_line_t;                        // 0 -> Idle
-                                    // 1 -> Shared
-                                    // 2 -> Exclusive
-                                    // 3 -> Modified
+// Compile-time L1 geometry
+// Used for common configurations so that set/tag extraction and the way
+// loops are constant-folded and unrolled.
+template <long SIZE, int ASSOC, int LINESIZE>
+struct FixedGeometry {
+    FixedGeometry(const sim_config_t & /*config*/) {}
+
+    static constexpr int assoc() { return ASSOC; }
+    static constexpr int linesize() { return LINESIZE; }
+    static constexpr long sets() { return SIZE / ASSOC / LINESIZE; }
+    static constexpr int block_bits() { return log2Exact(LINESIZE); }
+    static constexpr int tag_shift() { return block_bits() + log2Exact(sets()); }
+    static constexpr unsigned long set_mask() { return sets() - 1; }
+    static constexpr int way_stride() { return (ASSOC + TAGS_PER_BLOCK - 1) / TAGS_PER_BLOCK * TAGS_PER_BLOCK; }
+};
+
+// Runtime L1 geometry for every other configuration
+struct DynamicGeometry {
+    DynamicGeometry(const sim_config_t &config)
+        : assoc_(config.l1_assoc), linesize_(config.l1_linesize),
+          sets_(config.l1_size / config.l1_assoc / config.l1_linesize),
+          block_bits_(log2Exact(linesize_)), tag_shift_(block_bits_ + log2Exact(sets_)),
+          set_mask_(sets_ - 1),
+          way_stride_((assoc_ + TAGS_PER_BLOCK - 1) / TAGS_PER_BLOCK * TAGS_PER_BLOCK) {}
+
+    int assoc() const { return assoc_; }
+    int linesize() const { return linesize_; }
+    long sets() const { return sets_; }
+    int block_bits() const { return block_bits_; }
+    int tag_shift() const { return tag_shift_; }
+    unsigned long set_mask() const { return set_mask_; }
+    int way_stride() const { return way_stride_; }
+
+    int assoc_;
+    int linesize_;
+    long sets_;
+    int block_bits_;
+    int tag_shift_;
+    unsigned long set_mask_;
+    int way_stride_;
+};
+
+// Splits addresses into L1 set and tag
+// The shift amounts and set mask are computed once by the geometry (and are
+// compile-time constants for a FixedGeometry).
+template <class Geometry>
+struct AddressDecoder {
+    AddressDecoder(const Geometry &geom) : geom(geom) {}
+
+    long set(long addr) const {
+        return (long)(((unsigned long)addr >> geom.block_bits()) & geom.set_mask());
+    }
+    long tag(long addr) const {
+        return (long)((unsigned long)addr >> geom.tag_shift());
+    }
+    // Line address (address without block offset)
+    long line(long addr) const {
+        return (long)((unsigned long)addr >> geom.block_bits());
+    }
+    // Line address of a resident tag
+    long lineOf(long tag, long set) const {
+        return (long)(((unsigned long)tag << (geom.tag_shift() - geom.block_bits())) | set);
+    }
 
+    Geometry geom;
+};
+
+// Cache Structures
+//
+// Structure of arrays: the tags of a set are contiguous and cache-line
+// aligned so a lookup touches one (or two, above 8 ways) host lines, and
+// the LRU stamps and states live in separate arrays with the same stride.
+// Policies other than LRU keep their per-set words in another array.
 typedef struct {
-    L1_line_t L1_Cache[L1_DCACHE_SETS]; /* Array of lines matching L1 Cache*/
+    uint64_t *tag;      /* tag for the line, INVALID_TAG if invalid */
+    long     *opCount;  /* latest operation which used the line */
+    uint8_t  *state;    /* Cache Coherence State (coh_state_t) */
+    uint64_t *repl;     /* replacement policy words of the set */
+} L1_line_t;
+
+// Aligned so that cores simulated on different threads never share a host line
+typedef struct alignas(64) {
+    vector<tag_block_t> tag; // Tags of all ways, way_stride per set
+    vector<long> opCount;    // LRU stamps of all ways
+    vector<uint8_t> state;   // Coherence states of all ways
+    vector<uint64_t> repl;   // Replacement policy words, Policy::words per set
+    uint64_t repl_rng;       // Random victims / BRRIP insertion counter
     long memory_reads;       // Memory Reads
     long memory_writes;      // Memory Writes
     long count;              // Cycle Count
+    long instr_cycles;       // Part of count spent on non-memory instructions
     long evictions;          // Evictions
     long response_bus;       // Responses to Bus Transactions
+    long back_invalidations; // Lines removed by inclusive lower levels
+    long bus_traffic;        // Bus transactions issued (interconnect traffic)
+    long memory_fetches;     // Lines fetched from memory below the last level
+    long memory_writebacks;  // Lines written back to memory
+    long c2c_transfers;      // Misses supplied by another core's L1
+    long bus_wait;           // Cycles queued for the bus
+    long dram_wait;          // Cycles pushed back by later DRAM row hits
+    long remote_fetches;     // Memory fetches from another socket's node
+    long remote_writebacks;  // Memory writebacks to another socket's node
+    long cross_socket;       // Bus transactions that found the line on another socket
+    long remote_transfers;   // Cache-to-cache transfers from another socket
+    long link_wait;          // Cycles queued for the inter-socket link
+    uint64_t access_ip;      // Instruction of the access being run (stride prefetcher)
 } cache_t;
 
+// Per-core state of the parallel engines
+typedef struct {
+    long pos;                          // Position of the current access
+    vector<bus_msg_t> outbox;          // Bus transactions posted this epoch
+    vector<spec_event_t> log;          // L1 activity this epoch (deterministic)
+    vector<long> last_fill;            // Per L1 set, position of the latest fill
+    vector<long> last_l2;              // Per L2 set, position of the latest update
+    unordered_map<uint64_t, vector<spec_event_t>> events;  // Log of posted lines
+
+    // Checkpoint at the start of the epoch (deterministic)
+    cache_t saved;
+    cache_level_t saved_l2;
+    size_t saved_next;
+    thread_mark_t saved_pos;
+} core_engine_t;
+
+// Latest state a resolved bus transaction gave a line of a core
+typedef struct {
+    long pos;
+    int  state;
+} spec_override_t;
+
+// Find the way of a set holding tag, -1 if there is none
+// Compares the whole set at once (AVX2 or SSE4.1, scalar otherwise). Searching
+// for INVALID_TAG finds a free way; padding ways are masked off.
+template <class Geometry>
+static inline int findWay(const Geometry &geom, const uint64_t *tags, uint64_t tag) {
+    uint64_t mask = 0;
+    int i;
+
+#if defined(__AVX2__)
+    __m256i needle = _mm256_set1_epi64x(tag);
+    for (i = 0; i < geom.way_stride(); i += 4) {
+        __m256i ways = _mm256_load_si256((const __m256i *)(tags + i));
+        __m256i eq = _mm256_cmpeq_epi64(ways, needle);
+        mask |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << i;
+    }
+#elif defined(__SSE4_1__)
+    __m128i needle = _mm_set1_epi64x(tag);
+    for (i = 0; i < geom.way_stride(); i += 2) {
+        __m128i ways = _mm_load_si128((const __m128i *)(tags + i));
+        __m128i eq = _mm_cmpeq_epi64(ways, needle);
+        mask |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(eq)) << i;
+    }
+#else
+    for (i = 0; i < geom.assoc(); i++) {
+        if (tags[i] == tag) return i;
+    }
+    return -1;
+#endif
+
+    if (geom.assoc() < 64) mask &= ((uint64_t)1 << geom.assoc()) - 1;
+    return mask ? __builtin_ctzll(mask) : -1;
+}
+
+// Multi-core cache simulator for one configuration
+template <class Geometry, class Policy>
+class Simulator {
+  public:
+    Simulator(const sim_config_t &config);
+
+    int run(const schedule_t &schedule);
+    int runSchedule(const schedule_t &schedule);
+    int bench(long accesses);
+    void printStats();
+    void summarize(sweep_result_t *result);
+    void useThreads(const vector<threadinfo_t *> &views);
+    void collectStats(FILE *timeline, long interval);
+    int writeStats(const char *path);
+
+  private:
+    L1_line_t getSet(int core, long set);
+    repl_set_t replSet(const L1_line_t &line) const;
+    int BusRd_Cache(int dest, int source, long addr);
+    int BusRdx_Cache(int dest, long addr);
+    int BusTransaction(int source, long addr, bus_op_t op);
+    int snoopCore(int dest, int source, long addr, bus_op_t op);
+    void busOccupy(int source, bus_op_t op);
+    void processCacheRead(int core, long addr);
+    void processCacheWrite(int core, long addr);
+    void runTaskTrace(int core, threadinfo_t *thread_info);
+    void runAccess(int core, const trace_access_t *access);
+    long chargeInstructions(int core, const trace_access_t *access);
+    void runAccessLines(int core, const trace_access_t *access);
+    int runRound(vector<run_queue_t> &queues);
+    int runEvents(vector<run_queue_t> &queues);
+    int runEpochs(vector<run_queue_t> &queues);
+    void runCoreEpoch(int core, run_queue_t &queue, long first_round, long last_round);
+    void saveCore(int core, const run_queue_t &queue);
+    void restoreCore(int core, run_queue_t &queue);
+    void logEvent(int core, uint64_t line, int kind, int state);
+    void indexEvents(int core, const unordered_set<uint64_t> &lines);
+    int stateAt(int core, uint64_t line, long pos, const spec_override_t *ov);
+    int eventAfter(int core, uint64_t line, long pos, int kinds);
+    int validateEpoch(const vector<bus_msg_t> &msgs, long epoch_pos);
+    void applyEpoch(const vector<bus_msg_t> &msgs);
+    long fetchLine(int core, long addr);
+    long fetchBelowL2(int core, uint64_t line);
+    void prefetchDemand(int core, long addr, int hit);
+    void prefetchL1(int core, uint64_t line);
+    long prefetchL2Demand(int core, uint64_t line, int hit);
+    void prefetchL2(int core, uint64_t line);
+    void prefetchLost(int core, int level, uint64_t line);
+    long memoryRead(int core, uint64_t line);
+    void memoryWrite(int core, uint64_t line);
+    int socketOf(int core) const;
+    int homeNode(int core, uint64_t line);
+    long linkCross(int core, int posted);
+    long missLatency(int core, long addr, int snoop);
+    void writeBack(int core, int from, uint64_t line, int dirty);
+    void flushWriteBack(int core, int source, uint64_t line);
+    void insertL2(int core, uint64_t line, int dirty);
+    void insertLLC(int core, uint64_t line, int dirty);
+    int invalidateL1(int core, uint64_t line);
+
+    sim_config_t config;
+    const coh_protocol_t *proto;
+    Geometry geom;
+    AddressDecoder<Geometry> decoder;
+
+    // Per-core caches
+    vector<cache_t> Cache;
+
+    // Tasks replayed by id (thread_list, or private cursors in a sweep)
+    task_table_t tasks;
+
+    // Accesses executed per access replayed, per core and overall (sampled traces)
+    vector<double> sample_scale;
+    double total_sample_scale;
+
+    // Sharer directory (if config.directory)
+    directory_t directory;
+
+    // Bus contention (if config.bus_bandwidth)
+    bus_t bus;
+    long bus_flush;                // Occupancy of flushes within the current transaction
+
+    // Memory controller of each socket's node (if hasDRAM(&config))
+    vector<dram_t> dram;
+    long write_clock;              // Cycle of a snoop flush's writeback, -1 for the writing core's
+
+    // Prefetchers per core (if config.l1_prefetcher / l2_prefetcher)
+    vector<prefetcher_t> l1_pf;
+    vector<prefetcher_t> l2_pf;
+
+    // Sockets (if hasSockets(&config))
+    int cores_per_socket;
+    unordered_map<uint64_t, int> page_home;  // Page -> node, first touch
+    vector<long> node_pages;                 // Pages placed per node
+    bus_t link;                              // Contention if config.numa_link_bandwidth
+    long link_transfers;                     // Lines that crossed the link
+
+    // Lower levels: private L2 per core and shared LLC (if configured)
+    int has_l2;
+    int has_llc;
+    vector<cache_level_t> L2;
+    vector<cache_level_t> LLC;     // One per socket
+
+    // Parallel engines (parallelEngine(&config))
+    int speculative;               // Post bus transactions instead of probing
+    int logging;                   // Log L1 activity for validation
+    vector<core_engine_t> engine;
+    long epochs;
+    long replays;                  // Epochs re-run sequentially
+
+    // Detailed statistics (--stats / --timeline, sequential engine)
+    int collect_stats;
+    sim_stats_t stats;
+};
+
 // Global vector containing pointers to all threads
 vector<threadinfo_t *> thread_list;
 
-// Global vector containing pointer to cache
-cache_t Cache[NUM_CORES];
+// Loaded tasks indexed by id
+task_table_t task_table;
 
-// Global variable for total threads
-long total_threads = 0;
+// Mappings of binary trace files (if any)
+vector<trace_map_t> trace_maps;
 
-// Global variable tracking interconnect traffic
-long interconnect_traffic = 0;
+// Streaming mode: trace files and resident address window in bytes
+int stream_trace = 0;
+vector<int> trace_fds;
+long stream_window = 64L << 20;
 
-// Bus Transaction Prototype
-int BusTransaction(int source, long addr, bus_op_t op);
+// Detailed statistics and timeline outputs (NULL if not requested)
+const char *stats_path = NULL;
+const char *timeline_path = NULL;
+long timeline_interval = 10000;
+int classify_misses = 0;           // Print the miss breakdown only
 
-// Function to parse Trace file
-int parseTrace() {
-    
-    FILE *fptr;
+// Global variable for total threads
+long total_threads = 0;
 
-    fptr = fopen("/home/joshua/15418/CacheSimulator/mm.out", "r");
+// Whether every thread of the trace records instruction addresses, which
+// the stride prefetcher is indexed by
+int trace_ips = 1;
+atomic<int> stride_warned(0);
+
+// Function to parse Trace files
+// Binary traces (see tracecvt) are mapped in place or streamed (sized for
+// active_cores tasks running at once), text traces are copied. The threads
+// of several files (e.g. the per-thread files of the Pin tool) form one trace.
+int parseTrace(const vector<const char *> &paths, int active_cores) {
+
+    for (const char *path : paths) {
+        if (stream_trace) {
+            int fd;
+            if (openStreamTrace(path, stream_window, active_cores, &fd, thread_list) == -1) {
+                return -1;
+            }
+            trace_fds.push_back(fd);
+        }
+        else if (isBinaryTrace(path)) {
+            trace_map_t map;
+            if (mapBinaryTrace(path, &map, thread_list) == -1) {
+                return -1;
+            }
+            trace_maps.push_back(map);
+        }
+        else if (readTextTrace(path, thread_list) == -1) {
+            return -1;
+        }
+    }
 
-    if (fptr == NULL) {
-        printf("Error Opening Trace File!");
+    if (buildTaskTable(thread_list, &task_table) == -1) {
         return -1;
     }
 
-    char *line = NULL;
-    size_t len = 0;
-    size_t read;
+    for (const threadinfo_t *t : thread_list) {
+        if (!t->has_ip) trace_ips = 0;
+    }
 
-    int count = 0;
+    printf("Total Threads: %d\n", (int)thread_list.size());
+    total_threads = thread_list.size();
+    return 0;
+}
 
-    while ((read = getline(&line, &len, fptr)) != -1) {
-        
-        // End of trace
-        if (strcmp("#eof\n", line) == 0) break;
+// Check that a schedule fits num_cores and runs each traced task at most once
+int checkSchedule(const schedule_t &schedule, int num_cores) {
+    if (scheduleCores(schedule) > num_cores) {
+        printf("Schedule %s needs %d cores, num_cores is %d\n",
+               schedule.name.c_str(), scheduleCores(schedule), num_cores);
+        return -1;
+    }
 
-        // Struct containing info about trace
-        threadinfo_t *this_thread_info = new threadinfo_t();
+    unordered_set<threadinfo_t *> seen;
+    for (const vector<int> &tasks : schedule.cores) {
+        for (int task : tasks) {
+            threadinfo_t *t = lookupTask(&task_table, task);
+            if (t == NULL) {
+                printf("Schedule %s: task %d is not in the trace\n", schedule.name.c_str(), task);
+                return -1;
+            }
+            if (!seen.insert(t).second) {
+                printf("Schedule %s: task %d is scheduled twice\n", schedule.name.c_str(), task);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
 
-        // Get thread_id
-        char* tok = strtok(line, "(,");
-        this_thread_info->thread_id = atoi(tok);
+template <class Geometry, class Policy>
+Simulator<Geometry, Policy>::Simulator(const sim_config_t &config)
+    : config(config), proto(&coh_protocols[config.protocol]), geom(config), decoder(geom), Cache(config.num_cores),
+      has_l2(config.l2_size > 0), has_llc(config.llc_size > 0), speculative(0), logging(0),
+      epochs(0), replays(0), collect_stats(0) {
+
+    total_sample_scale = 1.0;
+    long ways = geom.sets() * geom.way_stride();
+
+    dirInit(&directory);
+    busInit(&bus, config.bus_arbitration, config.num_cores);
+    bus_flush = 0;
+    dram.resize(config.sockets);
+    for (dram_t &node : dram) {
+        dramInit(&node, config.dram_channels, config.dram_banks, config.dram_row_size / config.l1_linesize,
+                 config.dram_page, config.dram_queue, config.dram_cas, config.dram_rcd, config.dram_rp,
+                 config.dram_burst);
+    }
+    write_clock = -1;
+    cores_per_socket = config.num_cores / config.sockets;
+    node_pages.assign(config.sockets, 0);
+    busInit(&link, ArbitrationFCFS, config.num_cores);
+    link_transfers = 0;
+    buildTaskTable(thread_list, &tasks);
+
+    for (cache_t &c : Cache) {
+        c.tag.resize(ways / TAGS_PER_BLOCK);
+        for (tag_block_t &block : c.tag) {
+            for (uint64_t &t : block.tag) t = INVALID_TAG;
+        }
+        c.opCount.assign(ways, 0);
+        c.state.assign(ways, 0);
+        c.repl.assign(geom.sets() * Policy::words, 0);
+        c.repl_rng = 0x9E3779B97F4A7C15ull * (&c - &Cache[0] + 1);
+        c.memory_reads = 0;
+        c.memory_writes = 0;
+        c.count = 0;
+        c.instr_cycles = 0;
+        c.evictions = 0;
+        c.response_bus = 0;
+        c.back_invalidations = 0;
+        c.bus_traffic = 0;
+        c.memory_fetches = 0;
+        c.memory_writebacks = 0;
+        c.c2c_transfers = 0;
+        c.bus_wait = 0;
+        c.dram_wait = 0;
+        c.remote_fetches = 0;
+        c.remote_writebacks = 0;
+        c.cross_socket = 0;
+        c.remote_transfers = 0;
+        c.link_wait = 0;
+        c.access_ip = 0;
+    }
 
-        // Get Instruction Count
-        tok = strtok(NULL, "(,");
-        this_thread_info->instr_count = atoi(tok);
+    // Without instruction addresses every access would share one stride
+    // table entry
+    if (!trace_ips && (this->config.l1_prefetcher == PrefetchStride || this->config.l2_prefetcher == PrefetchStride)) {
+        if (!stride_warned.exchange(1)) {
+            printf("The trace has no instruction addresses, stride prefetcher disabled\n");
+        }
+        if (this->config.l1_prefetcher == PrefetchStride) this->config.l1_prefetcher = PrefetchNone;
+        if (this->config.l2_prefetcher == PrefetchStride) this->config.l2_prefetcher = PrefetchNone;
+    }
 
-        // Extract Read / Write Mem Traces
-        tok = strtok(NULL, "[");
-        char *read_mem_log = strtok(NULL, "]");
-        tok = strtok(NULL, "[");
-        char *write_mem_log = strtok(NULL, "]");
+    if (this->config.l1_prefetcher != PrefetchNone) {
+        l1_pf.resize(config.num_cores);
+        for (prefetcher_t &pf : l1_pf) {
+            prefetchInit(&pf, config.l1_prefetcher, config.prefetch_degree, config.prefetch_table);
+        }
+    }
+    if (this->config.l2_prefetcher != PrefetchNone) {
+        l2_pf.resize(config.num_cores);
+        for (prefetcher_t &pf : l2_pf) {
+            prefetchInit(&pf, config.l2_prefetcher, config.prefetch_degree, config.prefetch_table);
+        }
+    }
 
-        // Parse read_mem_log
-        char* term = strtok(read_mem_log, ",");
-        while(term) {
-            char *ptr;
-            this_thread_info->read_list.push_back(strtol(term, &ptr, 10));
-            term = strtok(NULL, ",");
+    if (has_l2) {
+        L2.resize(config.num_cores);
+        for (cache_level_t &level : L2) {
+            levelInit(&level, config.l2_size, config.l2_assoc, config.l1_linesize);
+        }
+    }
+    if (has_llc) {
+        LLC.resize(config.sockets);
+        for (cache_level_t &level : LLC) {
+            levelInit(&level, config.llc_size, config.llc_assoc, config.l1_linesize);
         }
+    }
 
-        // Parse write_mem_log
-        term = strtok(write_mem_log, ",");
-        while(term) {
-            char *ptr;
-            this_thread_info->write_list.push_back(strtol(term, &ptr, 10));
-            term = strtok(NULL, ",");
+    if (parallelEngine(&config)) {
+        engine.resize(config.num_cores);
+        for (int i = 0; i < config.num_cores; i++) {
+            engine[i].last_fill.assign(geom.sets(), -1);
+            if (has_l2) engine[i].last_l2.assign(L2[i].sets, -1);
         }
+    }
+}
+
+// Replay the given cursors instead of thread_list
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::useThreads(const vector<threadinfo_t *> &views) {
+    buildTaskTable(views, &tasks);
+}
 
-        // Store thread info
-        thread_list.push_back(this_thread_info);
-        count++;
+// Count per task / set statistics and classify misses, and write a timeline row per core every
+// interval steps if timeline is set
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::collectStats(FILE *timeline, long interval) {
+    collect_stats = 1;
+    statsInit(&stats, config.num_cores, geom.sets(), geom.assoc());
+    if (timeline != NULL) {
+        statsStartTimeline(&stats, timeline, interval);
     }
+}
 
-    printf("Total Threads: %d\n", count);
-    total_threads = count;
-    return 0;
+// Write the statistics, JSON if path ends in .json, else CSV
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::writeStats(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        printf("Error Opening Stats File!\n");
+        return -1;
+    }
+
+    size_t len = strlen(path);
+    if (len >= 5 && strcmp(path + len - 5, ".json") == 0) {
+        writeStatsJSON(out, &stats);
+    }
+    else {
+        writeStatsCSV(out, &stats);
+    }
+    return fclose(out) == 0 ? 0 : -1;
 }
 
-// Simulate BusRd Behavior on specific Cache
-int BusRd_Cache(int dest, long addr) {
+// Get the ways of one set
+template <class Geometry, class Policy>
+L1_line_t Simulator<Geometry, Policy>::getSet(int core, long set) {
+    long base = set * geom.way_stride();
+    L1_line_t line = {Cache[core].tag[base / TAGS_PER_BLOCK].tag, &Cache[core].opCount[base],
+                      &Cache[core].state[base], Cache[core].repl.data() + set * Policy::words};
+    return line;
+}
 
-    // Calculate Bits
-    int L1_block_bits = log2(L1_DCACHE_LINESIZE);
-    int L1_idx_bits = log2(L1_DCACHE_SETS);
-    int L1_tag_bits = 64 - L1_idx_bits - L1_block_bits;
+// Replacement state of a set, for the policy
+template <class Geometry, class Policy>
+repl_set_t Simulator<Geometry, Policy>::replSet(const L1_line_t &line) const {
+    repl_set_t set = {line.opCount, line.repl, geom.assoc()};
+    return set;
+}
+
+// Simulate BusRd Behavior on specific Cache
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::BusRd_Cache(int dest, int source, long addr) {
 
     // Compute terms
-    long set = (long)(((unsigned long)(addr << L1_tag_bits)) >> (L1_tag_bits + L1_block_bits));
-    long tag = (long)((unsigned long)addr >> L1_idx_bits + L1_block_bits);
+    long set = decoder.set(addr);
+    long tag = decoder.tag(addr);
+
+    L1_line_t line = getSet(dest, set);
 
     long count = Cache[dest].count;
 
-    int i;
     int found_matching = 0;
+    int result = 0;
 
-    // Search for matching address in cache (either in exclusive, shared,
-    // modified)
-    for (i = 0; i < L1_DCACHE_ASSOC; i++) {
-        if (Cache[dest].L1_Cache[set].tag[i] == tag &&
-            (Cache[dest].L1_Cache[set].state[i] == 1 ||
-             Cache[dest].L1_Cache[set].state[i] == 2 ||
-             Cache[dest].L1_Cache[set].state[i] == 3)) {
-            
-            // Mark found_matching
-            found_matching = 1;
-            
-            if (Cache[dest].L1_Cache[set].state[i] == 1) {
-                // Do nothing if state is shared
-                break;
-            }
+    // Search for matching address in cache (any valid state)
+    int i = findWay(geom, line.tag, tag);
 
-            // Increase cache response (not for shared state)
-            Cache[dest].response_bus += 1;
+    if (i != -1) {
+        // Mark found_matching
+        found_matching = 1;
+        result = SNOOP_FOUND;
 
-            if (Cache[dest].L1_Cache[set].state[i] == 2) {
-                // Transition from exclusive to shared
-                Cache[dest].L1_Cache[set].state[i] = 1;
-                break;
-            }
+        coh_snoop_t snoop = proto->bus_rd[line.state[i]];
+        line.state[i] = snoop.next;
 
-            if (Cache[dest].L1_Cache[set].state[i] == 3) {
-                // Transition from modified to shared
-                Cache[dest].L1_Cache[set].state[i] = 1;
+        // Increase cache response (not for shared state)
+        if (snoop.flags & SNOOP_RESPOND) {
+            Cache[dest].response_bus += 1;
+        }
+        if (snoop.flags & SNOOP_FLUSH) {
+            if (collect_stats) statsFlush(&stats, dest, set);
 
-                //Flush
-                bus_op_t op = Flush;
-                BusTransaction(dest, addr, op);
+            //Flush
+            bus_op_t op = Flush;
+            BusTransaction(dest, addr, op);
 
-                break;
+            // The copy left behind is clean (MESI / MESIF M -> S): the
+            // flushed data is written back below
+            if (!proto->dirty[snoop.next]) {
+                flushWriteBack(dest, source, decoder.line(addr));
             }
-
-            break;
+        }
+        if (snoop.flags & SNOOP_SUPPLY) {
+            result |= SNOOP_SUPPLIED;
         }
     }
 
     // Increment internal count because cache operation was done
     Cache[dest].count = count + found_matching;
 
-    // Return if shared entires were found
-    return found_matching;
+    // Return whether shared entries were found, and one supplied the line
+    return result;
 }
 
 // Simulate BusRd Behavior on specific Cache
-int BusRdx_Cache(int dest, long addr) {
-
-    // Calculate Bits
-    int L1_block_bits = log2(L1_DCACHE_LINESIZE);
-    int L1_idx_bits = log2(L1_DCACHE_SETS);
-    int L1_tag_bits = 64 - L1_idx_bits - L1_block_bits;
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::BusRdx_Cache(int dest, long addr) {
 
     // Compute terms
-    long set = (long)(((unsigned long)(addr << L1_tag_bits)) >> (L1_tag_bits + L1_block_bits));
-    long tag = (long)((unsigned long)addr >> L1_idx_bits + L1_block_bits);
+    long set = decoder.set(addr);
+    long tag = decoder.tag(addr);
+
+    L1_line_t line = getSet(dest, set);
 
     long count = Cache[dest].count;
 
-    int i;
     int found_matching = 0;
+    int result = 0;
 
-    // Search for matching address in cache (either in exclusive, shared,
-    // modified)
-    for (i = 0; i < L1_DCACHE_ASSOC; i++) {
-        if (Cache[dest].L1_Cache[set].tag[i] == tag &&
-            (Cache[dest].L1_Cache[set].state[i] == 1 ||
-             Cache[dest].L1_Cache[set].state[i] == 2 ||
-             Cache[dest].L1_Cache[set].state[i] == 3)) {
-            
-            // Mark found_matching
-            found_matching = 1;
+    // Search for matching address in cache (any valid state)
+    int i = findWay(geom, line.tag, tag);
 
-            // Increase cache response
-            Cache[dest].response_bus += 1;
+    if (i != -1) {
+        // Mark found_matching
+        found_matching = 1;
+        result = SNOOP_FOUND;
 
-            // Increase cache evictions
-            Cache[dest].evictions += 1;
-            
-            if (Cache[dest].L1_Cache[set].state[i] == 1) {
-                // Transition from exclusive to invalid
-                Cache[dest].L1_Cache[set].state[i] = 0;
-                break;
-            }
+        coh_snoop_t snoop = proto->bus_rdx[line.state[i]];
 
-            if (Cache[dest].L1_Cache[set].state[i] == 2) {
-                // Transition from exclusive to invalid
-                Cache[dest].L1_Cache[set].state[i] = 0;
-                break;
-            }
+        // Increase cache response
+        if (snoop.flags & SNOOP_RESPOND) {
+            Cache[dest].response_bus += 1;
+        }
 
-            if (Cache[dest].L1_Cache[set].state[i] == 3) {
-                // Transition from modified to invalid
-                Cache[dest].L1_Cache[set].state[i] = 0;
+        // Increase cache evictions
+        Cache[dest].evictions += 1;
 
-                //Flush
-                bus_op_t op = Flush;
-                BusTransaction(dest, addr, op);
-                break;
-            }
+        if (snoop.flags & SNOOP_FLUSH) {
+            if (collect_stats) statsFlush(&stats, dest, set);
 
-            break;
+            //Flush
+            bus_op_t op = Flush;
+            BusTransaction(dest, addr, op);
+        }
+        if (snoop.flags & SNOOP_SUPPLY) {
+            result |= SNOOP_SUPPLIED;
         }
+        if (collect_stats) statsInvalidate(&stats, dest, set, decoder.line(addr));
+        prefetchLost(dest, 1, decoder.line(addr));
+
+        // Transition to invalid
+        line.state[i] = snoop.next;
+        line.tag[i] = INVALID_TAG;
+    }
+
+    // Line is no longer held here
+    if (config.directory && found_matching) {
+        dirRemoveSharer(&directory, decoder.line(addr), dest);
     }
 
     // Increment internal count because cache operation was done
     Cache[dest].count = count + found_matching;
 
-    // Return if shared entires were found
-    return found_matching;
+    // Return whether other copies were found, and one supplied the line
+    return result;
 }
 
 // Simulate Interconnect Behavior
-int BusTransaction(int source, long addr, bus_op_t op) {
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::BusTransaction(int source, long addr, bus_op_t op) {
     
     int i;
 
     int return_value = 0;
+
+    if (speculative) {
+        // Parallel engines: resolved at the end of the epoch, assuming
+        // for now that no other cache holds the line
+        bus_msg_t msg = {engine[source].pos, addr, source, op};
+        engine[source].outbox.push_back(msg);
+        return 0;
+    }
     
-    // Simulate effects of bus transaction on cache
-    for (i = 0; i < NUM_CORES; i++) {
+    if (config.directory && op != Flush) {
+        // Only probe the cores the directory lists as sharers
+        uint64_t sharers = dirLookup(&directory, decoder.line(addr), source, config.num_cores);
 
-        if (i == source) {
-            // We ignore effects of bus transaction on own cache
-            continue;
+        while (sharers) {
+            i = __builtin_ctzll(sharers);
+            sharers &= sharers - 1;
+
+            return_value |= snoopCore(i, source, addr, op);
         }
+    }
+    else {
+        // Simulate effects of bus transaction on cache
+        for (i = 0; i < config.num_cores; i++) {
+
+            if (i == source) {
+                // We ignore effects of bus transaction on own cache
+                continue;
+            }
 
-        if (op == BusRd) {
-            // Carry our BusRd operation on cache
-            if (BusRd_Cache(i, addr)) {
-                return_value = 1;
+            if (op != Flush) {
+                // Carry out the BusRd / BusRdX operation on cache
+                return_value |= snoopCore(i, source, addr, op);
             }
         }
-        else if (op == BusRdX) {
-            // Carry our BusRdx operation on cache
-            if (BusRdx_Cache(i, addr)) {
-                return_value = 1;
+    }
+
+    if (return_value & SNOOP_CROSS) {
+        Cache[source].cross_socket += 1;
+    }
+
+    // Remote private L2 copies become stale on a write, as do the copies
+    // in other sockets' LLCs
+    if (has_l2 && op == BusRdX) {
+        uint64_t line = decoder.line(addr);
+        int dirty;
+        for (i = 0; i < config.num_cores; i++) {
+            if (i != source && levelInvalidate(&L2[i], line, &dirty)) {
+                prefetchLost(i, 2, line);
             }
         }
     }
+    if (has_llc && hasSockets(&config) && op == BusRdX) {
+        uint64_t line = decoder.line(addr);
+        int dirty;
+        for (i = 0; i < config.sockets; i++) {
+            if (i != socketOf(source)) levelInvalidate(&LLC[i], line, &dirty);
+        }
+    }
+
+    // Hold the bus (a flush extends the transaction that caused it)
+    if (config.bus_bandwidth > 0) {
+        busOccupy(source, op);
+    }
 
     // Increment Interconnect Traffic
-    // NOTE: Flush does nothing but increment this counter
-    interconnect_traffic += 1;
+    // NOTE: Flush only increments this counter; the data goes down the
+    // hierarchy through the snooping core (flushWriteBack)
+    Cache[source].bus_traffic += 1;
 
-    // Return return value (whether there is shared state)
+    // Return return value (SNOOP_FOUND if there is shared state, and
+    // SNOOP_SUPPLIED if another cache sent the line)
     // So that we know if we're exclusive or shared
     return return_value;
 }
 
-// Process Cache Read
-void processCacheRead(int core, long addr) {
+// Snoop one core's L1 for a BusRd / BusRdX of source
+// Copies found on another socket are marked for the cross-socket counts.
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::snoopCore(int dest, int source, long addr, bus_op_t op) {
+    int result = op == BusRd ? BusRd_Cache(dest, source, addr) : BusRdx_Cache(dest, addr);
 
-    // Calculate Bits
-    int L1_block_bits = log2(L1_DCACHE_LINESIZE);
-    int L1_idx_bits = log2(L1_DCACHE_SETS);
-    int L1_tag_bits = 64 - L1_idx_bits - L1_block_bits;
+    if ((result & SNOOP_FOUND) && socketOf(dest) != socketOf(source)) {
+        result |= SNOOP_CROSS;
+        if (result & SNOOP_SUPPLIED) result |= SNOOP_REMOTE;
+    }
+    return result;
+}
+
+// Queue a transaction of source for the bus and charge its wait
+// A transaction occupies the bus for the op's command cycles plus the line
+// at bus_bandwidth bytes per cycle. Flushes answer the transaction being
+// snooped, so their occupancy is added to it.
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::busOccupy(int source, bus_op_t op) {
+    const int cycles[] = {config.bus_rd_cycles, config.bus_rdx_cycles, config.bus_flush_cycles};
+    long occupancy = cycles[op] + (config.l1_linesize + config.bus_bandwidth - 1) / config.bus_bandwidth;
+
+    if (op == Flush) {
+        bus_flush += occupancy;
+        return;
+    }
+
+    long wait = busRequest(&bus, source, Cache[source].count, occupancy + bus_flush);
+    bus_flush = 0;
+    Cache[source].count += wait;
+    Cache[source].bus_wait += wait;
+
+    for (const bus_push_t &push : bus.pushed) {
+        Cache[push.core].count += push.cycles;
+        Cache[push.core].bus_wait += push.cycles;
+    }
+}
+
+// Process Cache Read
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::processCacheRead(int core, long addr) {
 
     // Compute terms
-    long set = (long)(((unsigned long)(addr << L1_tag_bits)) >> (L1_tag_bits + L1_block_bits));
-    long tag = (long)((unsigned long)addr >> L1_idx_bits + L1_block_bits);
+    long set = decoder.set(addr);
+    long tag = decoder.tag(addr);
+
+    L1_line_t line = getSet(core, set);
 
     long count = Cache[core].count;
 
@@ -330,96 +828,115 @@ void processCacheRead(int core, long addr) {
     int found_match = 0;
     int i;
 
-    // Search for matching cache (either in exclusive, shared, modified)
-    for (i = 0; i < L1_DCACHE_ASSOC; i++) {
-        if (Cache[core].L1_Cache[set].tag[i] == tag &&
-            (Cache[core].L1_Cache[set].state[i] == 1 ||
-             Cache[core].L1_Cache[set].state[i] == 2 ||
-             Cache[core].L1_Cache[set].state[i] == 3)) {          
-            Cache[core].L1_Cache[set].opCount[i] = count;
-            found_match = 1; 
-
-            Cache[core].count = count + 1;
+    // Search for matching cache (any valid state)
+    i = findWay(geom, line.tag, tag);
+    if (i != -1) {
+        Policy::hit(replSet(line), i, count);
+        found_match = 1; 
 
-            break;
-        }
+        Cache[core].count = count + 1;
+        logEvent(core, decoder.line(addr), EventRead, 0);
+        if (collect_stats) statsHit(&stats, core, set, decoder.line(addr));
+    }
+    else if (collect_stats) {
+        statsMiss(&stats, core, set, decoder.line(addr));
     }
 
     // If not, search for empty way
     if (found_match == 0) {
         // Search for free cache
-        for (i = 0; i < L1_DCACHE_ASSOC; i++) {
-            if (Cache[core].L1_Cache[set].state[i] == 0) {
-                Cache[core].L1_Cache[set].tag[i] = tag;
-                Cache[core].L1_Cache[set].opCount[i] = count;
-                
-                // Update State for Read Transaction
-                bus_op_t op = BusRd;
-                if (BusTransaction(core, addr, op)) {
-                    // There is shared state
-                    Cache[core].L1_Cache[set].state[i] = 1;
-                }
-                else {
-                    Cache[core].L1_Cache[set].state[i] = 2;
-                }
+        i = findWay(geom, line.tag, INVALID_TAG);
+        if (i != -1) {
+            line.tag[i] = tag;
+            Policy::fill(replSet(line), i, count, &Cache[core].repl_rng);
 
-                Cache[core].count = count + L1_MISS_PENALTY;
+            if (config.directory) {
+                dirAddSharer(&directory, decoder.line(addr), core);
+            }
+            
+            // Update State for Read Transaction
+            bus_op_t op = BusRd;
+            int snoop = BusTransaction(core, addr, op);
+            if (snoop & SNOOP_FOUND) {
+                // There is shared state
+                line.state[i] = proto->fill_shared;
+            }
+            else {
+                line.state[i] = proto->fill_alone;
+            }
+            logEvent(core, decoder.line(addr), EventFill, line.state[i]);
 
-                found_free = 1;
+            Cache[core].count += missLatency(core, addr, snoop);
 
-                break;
-            }
+            found_free = 1;
         }
     }
 
     // Else, find one to evict
     if (found_match == 0 && found_free == 0) {
 
-        // Search for oldest way (LRU)
-        int oldest_way = 0;
-        long oldest_count = count;
-        for (i = 0; i < L1_DCACHE_ASSOC; i++) {
-            if (Cache[core].L1_Cache[set].opCount[i] < (long)oldest_count) {
-                oldest_way = i;
-                oldest_count = Cache[core].L1_Cache[set].opCount[i];
-            }
+        // Ask the replacement policy
+        int victim_way = Policy::victim(replSet(line), count, &Cache[core].repl_rng);
+
+        // Victim leaves this cache
+        uint64_t victim = decoder.lineOf(line.tag[victim_way], set);
+        int victim_dirty = proto->dirty[line.state[victim_way]];
+        if (config.directory) {
+            dirRemoveSharer(&directory, victim, core);
         }
+        if (collect_stats && victim_dirty) {
+            statsWriteback(&stats, core, set);
+        }
+        logEvent(core, victim, EventEvict, victim_dirty);
+        prefetchLost(core, 1, victim);
+
+        line.tag[victim_way] = tag;
+        Policy::fill(replSet(line), victim_way, count, &Cache[core].repl_rng);
 
-        Cache[core].L1_Cache[set].tag[oldest_way] = tag;
-        Cache[core].L1_Cache[set].opCount[oldest_way] = count;
+        if (config.directory) {
+            dirAddSharer(&directory, decoder.line(addr), core);
+        }
         
         // Update State for Read Transaction
         bus_op_t op = BusRd;
-        if (BusTransaction(core, addr, op)) {
+        int snoop = BusTransaction(core, addr, op);
+        if (snoop & SNOOP_FOUND) {
             // There is shared state
-            Cache[core].L1_Cache[set].state[i] = 1;
+            line.state[victim_way] = proto->fill_shared;
         }
         else {
-            Cache[core].L1_Cache[set].state[i] = 2;
+            line.state[victim_way] = proto->fill_alone;
         }
+        logEvent(core, decoder.line(addr), EventFill, line.state[victim_way]);
 
         // Increase cache evictions
         Cache[core].evictions += 1;
 
-        // Increase cache execution time
-        Cache[core].count = count + L1_MISS_PENALTY;
+        // Increase cache execution time (past any wait for the bus)
+        Cache[core].count += missLatency(core, addr, snoop);
+
+        // Hand the victim to the lower levels
+        writeBack(core, 1, victim, victim_dirty);
 
     }
 
+    // Train the prefetcher (a hit may wait for a late prefetch)
+    if (config.l1_prefetcher != PrefetchNone) {
+        prefetchDemand(core, addr, found_match);
+    }
+
     return;
 }
 
 // Process Cache Write
-void processCacheWrite(int core, long addr) {
-
-    // Calculate Bits
-    int L1_block_bits = log2(L1_DCACHE_LINESIZE);
-    int L1_idx_bits = log2(L1_DCACHE_SETS);
-    int L1_tag_bits = 64 - L1_idx_bits - L1_block_bits;
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::processCacheWrite(int core, long addr) {
 
     // Compute terms
-    long set = (long)(((unsigned long)(addr << L1_tag_bits)) >> (L1_tag_bits + L1_block_bits));
-    long tag = (long)((unsigned long)addr >> L1_idx_bits + L1_block_bits);
+    long set = decoder.set(addr);
+    long tag = decoder.tag(addr);
+
+    L1_line_t line = getSet(core, set);
 
     long count = Cache[core].count;
 
@@ -430,286 +947,1738 @@ void processCacheWrite(int core, long addr) {
     int found_match = 0;
     int i;
 
-    // Search for matching cache (either in exclusive, shared, modified)
-    for (i = 0; i < L1_DCACHE_ASSOC; i++) {
-        if (Cache[core].L1_Cache[set].tag[i] == tag &&
-            (Cache[core].L1_Cache[set].state[i] == 1 ||
-             Cache[core].L1_Cache[set].state[i] == 2 ||
-             Cache[core].L1_Cache[set].state[i] == 3)) {
-                  
-            Cache[core].L1_Cache[set].opCount[i] = count;
-            found_match = 1; 
-            Cache[core].count = count + 1;
-
-            // If exclusive, move to modified state
-            if (Cache[core].L1_Cache[set].state[i] == 2) {
-                Cache[core].L1_Cache[set].state[i] = 3;
-            }
-
-            // If shared, move to modified state and issue bus transaction
-            if (Cache[core].L1_Cache[set].state[i] == 1) {
-                Cache[core].L1_Cache[set].state[i] = 3;
-                bus_op_t op = BusRdX;
-                BusTransaction(core, addr, op);
-            }
-
-            break;
+    // Search for matching cache (any valid state)
+    i = findWay(geom, line.tag, tag);
+    if (i != -1) {
+        Policy::hit(replSet(line), i, count);
+        found_match = 1; 
+        Cache[core].count = count + 1;
+        if (collect_stats) statsHit(&stats, core, set, decoder.line(addr));
+
+        // Move to modified state, invalidating other copies unless the
+        // line is already exclusive (E / M)
+        int upgrade = proto->upgrade[line.state[i]];
+        line.state[i] = StateM;
+        if (upgrade) {
+            bus_op_t op = BusRdX;
+            BusTransaction(core, addr, op);
         }
+        logEvent(core, decoder.line(addr), EventWrite, StateM);
+    }
+    else if (collect_stats) {
+        statsMiss(&stats, core, set, decoder.line(addr));
     }
 
     // If not, search for empty way
     if (found_match == 0) {
         // Search for free cache
-        for (i = 0; i < L1_DCACHE_ASSOC; i++) {
-            if (Cache[core].L1_Cache[set].state[i] == 0) {
-                
-                // Update tag and op
-                Cache[core].L1_Cache[set].tag[i] = tag;
-                Cache[core].L1_Cache[set].opCount[i] = count;
+        i = findWay(geom, line.tag, INVALID_TAG);
+        if (i != -1) {
 
-                // Issue BusRdX
-                bus_op_t op = BusRdX;
-                BusTransaction(core, addr, op);
-                
-                // Update State to Modified
-                Cache[core].L1_Cache[set].state[i] = 3;
-
-                // Update Stats
-                Cache[core].count = count + L1_MISS_PENALTY;
-                found_free = 1;
+            // Update tag and op
+            line.tag[i] = tag;
+            Policy::fill(replSet(line), i, count, &Cache[core].repl_rng);
 
-                break;
+            if (config.directory) {
+                dirAddSharer(&directory, decoder.line(addr), core);
             }
+
+            // Issue BusRdX
+            bus_op_t op = BusRdX;
+            int snoop = BusTransaction(core, addr, op);
+            
+            // Update State to Modified
+            line.state[i] = StateM;
+            logEvent(core, decoder.line(addr), EventFill, StateM);
+
+            // Update Stats
+            Cache[core].count += missLatency(core, addr, snoop);
+            found_free = 1;
         }
     }
 
     // Else, find one to evict
     if (found_match == 0 && found_free == 0) {
 
-        // Search for oldest way (LRU)
-        int oldest_way = 0;
-        long oldest_count = count;
-        for (i = 0; i < L1_DCACHE_ASSOC; i++) {
-            if (Cache[core].L1_Cache[set].opCount[i] < (long)oldest_count) {
-                oldest_way = i;
-                oldest_count = Cache[core].L1_Cache[set].opCount[i];
-            }
+        // Ask the replacement policy
+        int victim_way = Policy::victim(replSet(line), count, &Cache[core].repl_rng);
+
+        // Victim leaves this cache
+        uint64_t victim = decoder.lineOf(line.tag[victim_way], set);
+        int victim_dirty = proto->dirty[line.state[victim_way]];
+        if (config.directory) {
+            dirRemoveSharer(&directory, victim, core);
         }
+        if (collect_stats && victim_dirty) {
+            statsWriteback(&stats, core, set);
+        }
+        logEvent(core, victim, EventEvict, victim_dirty);
+        prefetchLost(core, 1, victim);
 
         // Update tag and op
-        Cache[core].L1_Cache[set].tag[oldest_way] = tag;
-        Cache[core].L1_Cache[set].opCount[oldest_way] = count;
+        line.tag[victim_way] = tag;
+        Policy::fill(replSet(line), victim_way, count, &Cache[core].repl_rng);
+
+        if (config.directory) {
+            dirAddSharer(&directory, decoder.line(addr), core);
+        }
         
         // Issue BusRdX
         bus_op_t op = BusRdX;
-        BusTransaction(core, addr, op);
+        int snoop = BusTransaction(core, addr, op);
                 
         // Update State to Modified
-        Cache[core].L1_Cache[set].state[i] = 3;
+        line.state[victim_way] = StateM;
+        logEvent(core, decoder.line(addr), EventFill, StateM);
 
         // Increase cache evictions
         Cache[core].evictions += 1;
 
-        // Increase cache execution time
-        Cache[core].count = count + L1_MISS_PENALTY;
+        // Increase cache execution time (past any wait for the bus)
+        Cache[core].count += missLatency(core, addr, snoop);
+
+        // Hand the victim to the lower levels
+        writeBack(core, 1, victim, victim_dirty);
 
     }
 
+    // Train the prefetcher (a hit may wait for a late prefetch)
+    if (config.l1_prefetcher != PrefetchNone) {
+        prefetchDemand(core, addr, found_match);
+    }
+
     return;
 }
 
-// Run part of trace for single task on core
-int runTaskTrace(int core, int thread_id) {
-    
-    threadinfo_t *thread_info = NULL;
-    
-    // Find thread info
-    for (threadinfo_t *i : thread_list) {
-        if (i->thread_id == thread_id) thread_info = i;
-    }
+// Latency of an L1 miss
+// Looks the line up in L2, then the LLC, then memory, and fills the levels
+// it missed in according to the inclusion policy. Exclusive hierarchies
+// move the line up instead (a dirty copy is written back on the way, since
+// L1 dirtiness is tracked by the coherence state alone).
+template <class Geometry, class Policy>
+long Simulator<Geometry, Policy>::fetchLine(int core, long addr) {
 
-    // Return error if we cannot find thread_id
-    if (thread_info == NULL) {
-        printf("Thread Info not Found! Is thread_id correct?\n");
-        return -1;
+    uint64_t line = decoder.line(addr);
+
+    if (!has_l2 && !has_llc) {
+        if (!hasDRAM(&config) && !hasSockets(&config)) return config.l1_miss_penalty;
+        return memoryRead(core, line);
     }
 
-    if (thread_info->read_list.size() != 0) {
-        long mem_read_addr = thread_info->read_list.front();
-        thread_info->read_list.pop_front();
-        processCacheRead(core, mem_read_addr);
+    int exclusive = config.inclusion == Exclusive;
+    int dirty;
+
+    if (has_l2 && levelAccess(&L2[core], line)) {
+        if (exclusive && levelInvalidate(&L2[core], line, &dirty) && dirty) {
+            memoryWrite(core, line);
+        }
+        if (config.l2_prefetcher != PrefetchNone) {
+            return config.l2_latency + prefetchL2Demand(core, line, 1);
+        }
+        return config.l2_latency;
     }
 
-    if (thread_info->write_list.size() != 0) {
-        long mem_write_addr = thread_info->write_list.front();
-        thread_info->write_list.pop_front();
-        processCacheWrite(core, mem_write_addr);
+    long latency = fetchBelowL2(core, line);
+
+    if (has_l2 && !exclusive) {
+        insertL2(core, line, 0);
+    }
+    if (config.l2_prefetcher != PrefetchNone) {
+        prefetchL2Demand(core, line, 0);
     }
 
-    return 0;
+    return latency;
 }
 
-// Print Stats
-void printStats() {
-    printf("Interconnect Traffic: %ld\n\n", interconnect_traffic);
+// Latency of a line missing in L1 and L2, from the LLC or memory
+template <class Geometry, class Policy>
+long Simulator<Geometry, Policy>::fetchBelowL2(int core, uint64_t line) {
+    int exclusive = config.inclusion == Exclusive;
+    int dirty;
+    cache_level_t *llc = has_llc ? &LLC[socketOf(core)] : NULL;
 
-    int i;
+    if (has_llc && levelAccess(llc, line)) {
+        if (exclusive && levelInvalidate(llc, line, &dirty) && dirty) {
+            memoryWrite(core, line);
+        }
+        return config.llc_latency;
+    }
 
-    for (i = 0; i < NUM_CORES; i++) {
-        printf("**** CORE %d ****\n", i);
-        printf("Memory Reads: %ld\n", Cache[i].memory_reads);
-        printf("Memory Writes: %ld\n", Cache[i].memory_writes);
-        printf("Cycle Count: %ld\n", Cache[i].count);
-        printf("Evictions: %ld\n", Cache[i].evictions);
-        printf("Bus Responses: %ld\n\n", Cache[i].response_bus);
+    long latency = memoryRead(core, line);
+    if (has_llc && !exclusive) {
+        insertLLC(core, line, 0);
     }
+    return latency;
 }
 
-int main() {
+// Fetch a line from memory (its home node's), returns its latency
+// Without lower levels, memory costs l1_miss_penalty.
+template <class Geometry, class Policy>
+long Simulator<Geometry, Policy>::memoryRead(int core, uint64_t line) {
+    Cache[core].memory_fetches += 1;
 
-    // Parse memory trace
-    if (parseTrace() == -1) {
-        return -1;
-    }
+    int node = homeNode(core, line);
+    long latency = hasLowerLevels(&config) ? config.memory_latency : config.l1_miss_penalty;
 
-    // Task scheduling (back to front)
-    vector<int> CPU0{2, 6};
-    vector<int> CPU1{1, 19, 13, 7};
-    vector<int> CPU2{4, 43, 38, 33, 28, 23, 17, 11};
-    vector<int> CPU3{3, 44, 39, 34, 29, 24, 18, 12, 5};
-    vector<int> CPU4{56, 53, 50, 47, 42, 37, 32, 27, 22, 16, 10};
-    vector<int> CPU5{55, 52, 49, 46, 41, 36, 31, 26, 21, 15, 9};
-    vector<int> CPU6{54, 51, 48, 45, 40, 35, 30, 25, 20, 14, 8};
+    if (hasDRAM(&config)) {
+        latency = dramRequest(&dram[node], core, line, Cache[core].count);
+        for (const dram_push_t &push : dram[node].pushed) {
+            Cache[push.core].count += push.cycles;
+            Cache[push.core].dram_wait += push.cycles;
+        }
+    }
+    if (node != socketOf(core)) {
+        Cache[core].remote_fetches += 1;
+        latency += linkCross(core, 0);
+    }
+    return latency;
+}
 
-    while (1) {
-        if (CPU0.size() == 0 && CPU1.size() == 0 && CPU2.size() == 0 &&
-            CPU3.size() == 0 && CPU4.size() == 0 && CPU5.size() == 0 &&
-            CPU6.size() == 0) break;
-        
-        threadinfo_t *thread_info = NULL;
+// Write a dirty line back to memory (posted, the core does not wait)
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::memoryWrite(int core, uint64_t line) {
+    Cache[core].memory_writebacks += 1;
 
-        if (!CPU0.empty()) {
-            int thread_id = CPU0.back();
+    int node = homeNode(core, line);
 
-            // Run Trace
-            runTaskTrace(0, thread_id);
+    if (hasDRAM(&config)) {
+        dramRequest(&dram[node], -1, line, write_clock >= 0 ? write_clock : Cache[core].count);
+        for (const dram_push_t &push : dram[node].pushed) {
+            Cache[push.core].count += push.cycles;
+            Cache[push.core].dram_wait += push.cycles;
+        }
+    }
+    if (node != socketOf(core)) {
+        Cache[core].remote_writebacks += 1;
+        linkCross(core, 1);
+    }
+}
 
-            // Find thread info
-            for (threadinfo_t *i : thread_list) {
-                if (i->thread_id == thread_id) thread_info = i;
-            }
+// Socket of a core, cores are split over the sockets in order
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::socketOf(int core) const {
+    return core / cores_per_socket;
+}
 
-            if (thread_info->read_list.size() == 0 &&
-                thread_info->write_list.size() == 0) {
-                CPU0.pop_back();
-            }
-        }
+// Memory node holding line
+// First touch places a page on the socket of the first core that misses
+// on it (the first access to a page always misses).
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::homeNode(int core, uint64_t line) {
+    if (!hasSockets(&config)) {
+        return 0;
+    }
 
-        if (!CPU1.empty()) {
-            int thread_id = CPU1.back();
+    uint64_t page = line / (config.numa_page_size / config.l1_linesize);
+    if (config.numa_placement == Interleave) {
+        return (int)(page % config.sockets);
+    }
 
-            // Run Trace
-            runTaskTrace(1, thread_id);
+    auto placed = page_home.emplace(page, socketOf(core));
+    if (placed.second) node_pages[socketOf(core)] += 1;
+    return placed.first->second;
+}
 
-            // Find thread info
-            for (threadinfo_t *i : thread_list) {
-                if (i->thread_id == thread_id) thread_info = i;
-            }
+// Move a line of core over the inter-socket link, returns its latency
+// (0 for a posted writeback). The link is held for the line at
+// numa_link_bandwidth bytes per cycle; reads wait for it.
+template <class Geometry, class Policy>
+long Simulator<Geometry, Policy>::linkCross(int core, int posted) {
+    link_transfers += 1;
+
+    long wait = 0;
+    if (config.numa_link_bandwidth > 0) {
+        long occupancy = (config.l1_linesize + config.numa_link_bandwidth - 1) / config.numa_link_bandwidth;
+        wait = busRequest(&link, core, Cache[core].count, occupancy);
+    }
+    if (posted) {
+        return 0;
+    }
+    Cache[core].link_wait += wait;
+    return config.numa_link_latency + wait;
+}
 
-            if (thread_info->read_list.size() == 0 &&
-                thread_info->write_list.size() == 0) {
-                CPU1.pop_back();
-            }
+// Latency of an L1 miss given the outcome of its bus transaction
+// A line supplied by another core's L1 skips the lower levels.
+template <class Geometry, class Policy>
+long Simulator<Geometry, Policy>::missLatency(int core, long addr, int snoop) {
+    if (snoop & SNOOP_SUPPLIED) {
+        Cache[core].c2c_transfers += 1;
+        if (snoop & SNOOP_REMOTE) {
+            Cache[core].remote_transfers += 1;
+            return config.c2c_latency + linkCross(core, 0);
         }
+        return config.c2c_latency;
+    }
+    return fetchLine(core, addr);
+}
 
-        if (!CPU2.empty()) {
-            int thread_id = CPU2.back();
+// Account a demand access of core for its L1 prefetcher and issue the
+// prefetches it proposes. Trained on misses and first uses of prefetched
+// lines; a late prefetch holds the core until the line arrives.
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::prefetchDemand(int core, long addr, int hit) {
+    prefetcher_t &pf = l1_pf[core];
+    uint64_t line = decoder.line(addr);
+    long stall;
+
+    if (prefetchUse(&pf, line, hit, Cache[core].count, &stall)) {
+        Cache[core].count += stall;
+    }
+    else if (hit) {
+        return;
+    }
 
-            // Run Trace
-            runTaskTrace(2, thread_id);
+    prefetchTrain(&pf, line, Cache[core].access_ip);
+    for (int64_t target : pf.out) {
+        prefetchL1(core, (uint64_t)target);
+    }
+}
 
-            // Find thread info
-            for (threadinfo_t *i : thread_list) {
-                if (i->thread_id == thread_id) thread_info = i;
-            }
+// Bring a line into core's L1 ahead of use
+// Filled like a read miss (bus transaction, victim to the lower levels),
+// but the core does not wait: the line is marked with its arrival cycle.
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::prefetchL1(int core, uint64_t target) {
+    long addr = (long)(target << geom.block_bits());
+    long set = decoder.set(addr);
+    long tag = decoder.tag(addr);
+
+    L1_line_t line = getSet(core, set);
+    if (findWay(geom, line.tag, tag) != -1) {
+        return;
+    }
 
-            if (thread_info->read_list.size() == 0 &&
-                thread_info->write_list.size() == 0) {
-                CPU2.pop_back();
-            }
+    long count = Cache[core].count;
+    uint64_t victim = 0;
+    int victim_dirty = 0;
+
+    int i = findWay(geom, line.tag, INVALID_TAG);
+    int evict = i == -1;
+    if (evict) {
+        i = Policy::victim(replSet(line), count, &Cache[core].repl_rng);
+        victim = decoder.lineOf(line.tag[i], set);
+        victim_dirty = proto->dirty[line.state[i]];
+        if (config.directory) {
+            dirRemoveSharer(&directory, victim, core);
         }
+        if (collect_stats && victim_dirty) {
+            statsWriteback(&stats, core, set);
+        }
+        logEvent(core, victim, EventEvict, victim_dirty);
+        Cache[core].evictions += 1;
+        prefetchLost(core, 1, victim);
+    }
 
-        if (!CPU3.empty()) {
-            int thread_id = CPU3.back();
+    line.tag[i] = tag;
+    Policy::fill(replSet(line), i, count, &Cache[core].repl_rng);
+    if (config.directory) {
+        dirAddSharer(&directory, target, core);
+    }
 
-            // Run Trace
-            runTaskTrace(3, thread_id);
+    int snoop = BusTransaction(core, addr, BusRd);
+    line.state[i] = (snoop & SNOOP_FOUND) ? proto->fill_shared : proto->fill_alone;
 
-            // Find thread info
-            for (threadinfo_t *i : thread_list) {
-                if (i->thread_id == thread_id) thread_info = i;
-            }
+    // Bus wait and fetch latency delay the line, not the core
+    long latency = missLatency(core, addr, snoop) + Cache[core].count - count;
+    Cache[core].count = count;
+    prefetchIssued(&l1_pf[core], target, count + latency);
 
-            if (thread_info->read_list.size() == 0 &&
-                thread_info->write_list.size() == 0) {
-                CPU3.pop_back();
-            }
-        }
+    if (evict) {
+        writeBack(core, 1, victim, victim_dirty);
+    }
+}
 
-        if (!CPU4.empty()) {
-            int thread_id = CPU4.back();
+// Account an L1 miss reaching core's L2 for its prefetcher, returns the
+// cycles still to wait if it hit a late prefetch
+template <class Geometry, class Policy>
+long Simulator<Geometry, Policy>::prefetchL2Demand(int core, uint64_t line, int hit) {
+    prefetcher_t &pf = l2_pf[core];
+    long stall;
 
-            // Run Trace
-            runTaskTrace(4, thread_id);
+    if (!prefetchUse(&pf, line, hit, Cache[core].count, &stall) && hit) {
+        return 0;
+    }
 
-            // Find thread info
-            for (threadinfo_t *i : thread_list) {
-                if (i->thread_id == thread_id) thread_info = i;
-            }
+    prefetchTrain(&pf, line, Cache[core].access_ip);
+    for (int64_t target : pf.out) {
+        prefetchL2(core, (uint64_t)target);
+    }
+    return stall;
+}
 
-            if (thread_info->read_list.size() == 0 &&
-                thread_info->write_list.size() == 0) {
-                CPU4.pop_back();
-            }
-        }
+// Bring a line into core's L2 ahead of use
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::prefetchL2(int core, uint64_t target) {
+    if (levelFind(&L2[core], target) != -1) {
+        return;
+    }
 
-        if (!CPU5.empty()) {
-            int thread_id = CPU5.back();
+    long count = Cache[core].count;
+    long latency = fetchBelowL2(core, target) + Cache[core].count - count;
+    Cache[core].count = count;
 
-            // Run Trace
-            runTaskTrace(5, thread_id);
+    insertL2(core, target, 0);
+    prefetchIssued(&l2_pf[core], target, count + latency);
+}
 
-            // Find thread info
-            for (threadinfo_t *i : thread_list) {
-                if (i->thread_id == thread_id) thread_info = i;
-            }
+// A line left level (1 = L1, 2 = L2) of core: an unused prefetch of it was
+// useless
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::prefetchLost(int core, int level, uint64_t line) {
+    if (level == 1 && config.l1_prefetcher != PrefetchNone) {
+        prefetchDrop(&l1_pf[core], line);
+    }
+    if (level == 2 && config.l2_prefetcher != PrefetchNone) {
+        prefetchDrop(&l2_pf[core], line);
+    }
+}
+
+// Pass a line leaving level from (1 = L1, 2 = L2) to the levels below it
+// Exclusive hierarchies keep every victim (lower levels are victim
+// caches), the others only write dirty data back, allocating if needed.
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::writeBack(int core, int from, uint64_t line, int dirty) {
+
+    if (!hasLowerLevels(&config) && !hasDRAM(&config) && !hasSockets(&config)) {
+        return;
+    }
+
+    int exclusive = config.inclusion == Exclusive;
+
+    if (from < 2 && has_l2) {
+        if (exclusive || (dirty && !levelMarkDirty(&L2[core], line))) {
+            insertL2(core, line, dirty);
+        }
+        return;
+    }
+
+    if (from < 3 && has_llc) {
+        if (exclusive || (dirty && !levelMarkDirty(&LLC[socketOf(core)], line))) {
+            insertLLC(core, line, dirty);
+        }
+        return;
+    }
+
+    if (dirty) {
+        memoryWrite(core, line);
+    }
+}
+
+// Write back the dirty data a snoop flush took from core's L1
+// The L1 keeps the line, so an exclusive hierarchy (which holds only lines
+// no L1 has) sends it to memory instead of allocating it below. A write
+// reaching memory happens during source's transaction, so the DRAM sees it
+// at source's cycle (requests reach the controller in cycle order).
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::flushWriteBack(int core, int source, uint64_t line) {
+    write_clock = Cache[source].count;
+    if (config.inclusion != Exclusive) {
+        writeBack(core, 1, line, 1);
+    }
+    else if (hasLowerLevels(&config) || hasDRAM(&config) || hasSockets(&config)) {
+        memoryWrite(core, line);
+    }
+    write_clock = -1;
+}
+
+// Fill a core's L2, handling the victim
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::insertL2(int core, uint64_t line, int dirty) {
+    uint64_t victim;
+    int victim_dirty;
 
-            if (thread_info->read_list.size() == 0 &&
-                thread_info->write_list.size() == 0) {
-                CPU5.pop_back();
+    if (levelInsert(&L2[core], line, dirty, &victim, &victim_dirty)) {
+        prefetchLost(core, 2, victim);
+        if (config.inclusion == Inclusive) {
+            victim_dirty |= invalidateL1(core, victim);
+        }
+        writeBack(core, 2, victim, victim_dirty);
+    }
+}
+
+// Fill the LLC of core's socket, handling the victim
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::insertLLC(int core, uint64_t line, int dirty) {
+    uint64_t victim;
+    int victim_dirty;
+    int first = socketOf(core) * cores_per_socket;
+
+    if (levelInsert(&LLC[socketOf(core)], line, dirty, &victim, &victim_dirty)) {
+        if (config.inclusion == Inclusive) {
+            for (int i = first; i < first + cores_per_socket; i++) {
+                int l2_dirty;
+                if (has_l2 && levelInvalidate(&L2[i], victim, &l2_dirty)) {
+                    victim_dirty |= l2_dirty;
+                    prefetchLost(i, 2, victim);
+                }
+                victim_dirty |= invalidateL1(i, victim);
             }
         }
+        if (victim_dirty) {
+            memoryWrite(core, victim);
+        }
+    }
+}
+
+// Back-invalidate a line in one core's L1, returns 1 if it was modified
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::invalidateL1(int core, uint64_t line) {
+    long addr = (long)(line << geom.block_bits());
+    L1_line_t l = getSet(core, decoder.set(addr));
+
+    int i = findWay(geom, l.tag, decoder.tag(addr));
+    if (i == -1) {
+        return 0;
+    }
+
+    int dirty = proto->dirty[l.state[i]];
+    l.state[i] = StateI;
+    l.tag[i] = INVALID_TAG;
+    Cache[core].back_invalidations += 1;
+    logEvent(core, line, EventEvict, dirty);
+    prefetchLost(core, 1, line);
+
+    if (config.directory) {
+        dirRemoveSharer(&directory, line, core);
+    }
+    return dirty;
+}
+
+// Run part of trace for single task on core
+// Ordered traces replay one access per step, in program order; traces with
+// separate lists replay one read and one write
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::runTaskTrace(int core, threadinfo_t *thread_info) {
+
+    if (collect_stats) {
+        statsTask(&stats, core, thread_info->thread_id);
+    }
+
+    if (threadOrdered(thread_info)) {
+        trace_access_t access;
+        if (threadNextAccess(thread_info, &access)) {
+            runAccess(core, &access);
+        }
+        if (collect_stats) statsStep(&stats, core, Cache[core].count);
+        return;
+    }
+
+    long mem_read_addr;
+    if (threadNextRead(thread_info, &mem_read_addr)) {
+        processCacheRead(core, mem_read_addr);
+    }
+
+    // The write takes the next slot in the global order
+    if (speculative) {
+        engine[core].pos += 1;
+    }
+
+    long mem_write_addr;
+    if (threadNextWrite(thread_info, &mem_write_addr)) {
+        processCacheWrite(core, mem_write_addr);
+    }
+    if (collect_stats) statsStep(&stats, core, Cache[core].count);
+}
+
+// Replay one access of an ordered trace
+// The instructions executed since the previous access are charged first
+// (the access itself is charged by the cache).
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::runAccess(int core, const trace_access_t *access) {
+    chargeInstructions(core, access);
+    runAccessLines(core, access);
+}
+
+// Charge the instructions executed before an access, returns the cycles
+template <class Geometry, class Policy>
+long Simulator<Geometry, Policy>::chargeInstructions(int core, const trace_access_t *access) {
+    if (access->icount_delta <= 1) {
+        return 0;
+    }
+    long cycles = (long)(access->icount_delta - 1) * config.instr_cycles;
+    Cache[core].count += cycles;
+    Cache[core].instr_cycles += cycles;
+    return cycles;
+}
+
+// Access the lines of one access of an ordered trace
+// An access that straddles two lines touches both, the second in the next
+// slot of the global order.
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::runAccessLines(int core, const trace_access_t *access) {
+    long first = access->addr;
+    long last = access->size > 1 ? first + access->size - 1 : first;
+    int write = access->op == TRACE_OP_WRITE;
+
+    Cache[core].access_ip = access->ip;
+
+    if (write) processCacheWrite(core, first);
+    else processCacheRead(core, first);
+
+    if (decoder.line(last) != decoder.line(first)) {
+        if (speculative) {
+            engine[core].pos += 1;
+        }
+        if (write) processCacheWrite(core, last);
+        else processCacheRead(core, last);
+    }
+}
+
+// Print Stats
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::printStats() {
+    long interconnect_traffic = 0;
+    long memory_fetches = 0;
+    long memory_writebacks = 0;
+    long c2c_transfers = 0;
+    long remote_fetches = 0;
+    long remote_writebacks = 0;
+    long cross_socket = 0;
+    long remote_transfers = 0;
+    long link_wait = 0;
+    for (const cache_t &c : Cache) {
+        interconnect_traffic += c.bus_traffic;
+        c2c_transfers += c.c2c_transfers;
+        memory_fetches += c.memory_fetches;
+        memory_writebacks += c.memory_writebacks;
+        remote_fetches += c.remote_fetches;
+        remote_writebacks += c.remote_writebacks;
+        cross_socket += c.cross_socket;
+        remote_transfers += c.remote_transfers;
+        link_wait += c.link_wait;
+    }
+
+    if (parallelEngine(&config)) {
+        printf("Epochs: %ld (%ld replayed sequentially)\n", epochs, replays);
+    }
+    printf("Interconnect Traffic: %ld\n", interconnect_traffic);
+    if (config.protocol != ProtocolMESI) {
+        printf("Cache-to-Cache Transfers: %ld\n", c2c_transfers);
+    }
+    if (total_sample_scale > 1.0) {
+        printf("Extrapolated Interconnect Traffic: %ld\n", (long)(interconnect_traffic * total_sample_scale));
+    }
+    printf("\n");
+
+    if (config.directory) {
+        dirPrintStats(&directory);
+    }
+    if (config.bus_bandwidth > 0) {
+        busPrintStats(&bus);
+    }
 
-        if (!CPU6.empty()) {
-            int thread_id = CPU6.back();
+    for (int s = 0; has_llc && s < config.sockets; s++) {
+        char name[32];
+        if (hasSockets(&config)) snprintf(name, sizeof(name), "Socket %d LLC", s);
+        else snprintf(name, sizeof(name), "LLC");
+        levelPrintStats(name, &LLC[s]);
+        printf("\n");
+    }
+    if (hasLowerLevels(&config) || hasDRAM(&config) || hasSockets(&config)) {
+        printf("Memory Fetches: %ld\n", memory_fetches);
+        printf("Memory Writebacks: %ld\n\n", memory_writebacks);
+    }
+    if (hasSockets(&config)) {
+        printf("Remote Memory Fetches: %ld (%.2f%%)\n", remote_fetches,
+               memory_fetches ? 100.0 * remote_fetches / memory_fetches : 0.0);
+        printf("Remote Memory Writebacks: %ld\n", remote_writebacks);
+        printf("Cross-Socket Snoops: %ld\n", cross_socket);
+        printf("Cross-Socket Transfers: %ld\n", remote_transfers);
+        printf("Link Transfers: %ld\n", link_transfers);
+        if (config.numa_link_bandwidth > 0) {
+            printf("Link Utilization: %.2f%%\n", link.last_end ? 100.0 * link.busy_cycles / link.last_end : 0.0);
+            printf("Link Wait Cycles: %ld\n", link_wait);
+        }
+        if (config.numa_placement == FirstTouch) {
+            printf("Pages per Node:");
+            for (long pages : node_pages) printf(" %ld", pages);
+            printf("\n");
+        }
+        printf("\n");
+    }
+    if (config.l1_prefetcher != PrefetchNone) {
+        prefetchPrintStats("L1", l1_pf);
+        printf("\n");
+    }
+    if (config.l2_prefetcher != PrefetchNone) {
+        prefetchPrintStats("L2", l2_pf);
+        printf("\n");
+    }
+    for (int s = 0; hasDRAM(&config) && s < config.sockets; s++) {
+        if (hasSockets(&config)) printf("**** NODE %d ****\n", s);
+        dramPrintStats(&dram[s]);
+    }
 
-            // Run Trace
-            runTaskTrace(6, thread_id);
+    int i;
 
-            // Find thread info
-            for (threadinfo_t *i : thread_list) {
-                if (i->thread_id == thread_id) thread_info = i;
+    for (i = 0; i < config.num_cores; i++) {
+        printf("**** CORE %d ****\n", i);
+        printf("Memory Reads: %ld\n", Cache[i].memory_reads);
+        printf("Memory Writes: %ld\n", Cache[i].memory_writes);
+        printf("Cycle Count: %ld\n", Cache[i].count);
+        printf("Evictions: %ld\n", Cache[i].evictions);
+        printf("Bus Responses: %ld\n", Cache[i].response_bus);
+        if (config.bus_bandwidth > 0) {
+            printf("Bus Wait Cycles: %ld\n", Cache[i].bus_wait);
+        }
+        if (hasDRAM(&config)) {
+            printf("DRAM Reordering Cycles: %ld\n", Cache[i].dram_wait);
+        }
+        if (hasSockets(&config)) {
+            printf("Socket: %d\n", socketOf(i));
+            printf("Remote Memory Fetches: %ld\n", Cache[i].remote_fetches);
+            printf("Cross-Socket Snoops: %ld\n", Cache[i].cross_socket);
+        }
+        if (i < (int)sample_scale.size() && sample_scale[i] > 1.0) {
+            // The memory side is scaled up. Instruction cycles were all
+            // replayed, but include the skipped accesses at instr_cycles each.
+            double scale = sample_scale[i];
+            const cache_t &c = Cache[i];
+            long skipped = (long)((c.memory_reads + c.memory_writes) * (scale - 1));
+            long instr = max(c.instr_cycles - skipped * config.instr_cycles, 0L);
+            printf("Sampled: 1 in %.2f accesses replayed\n", scale);
+            printf("Extrapolated Cycle Count: %ld\n", instr + (long)((c.count - c.instr_cycles) * scale));
+            printf("Extrapolated Memory Reads: %ld\n", (long)(c.memory_reads * scale));
+            printf("Extrapolated Memory Writes: %ld\n", (long)(c.memory_writes * scale));
+        }
+        if (collect_stats) {
+            statsPrintCore(&stats, i);
+        }
+        if (has_l2) {
+            levelPrintStats("L2", &L2[i]);
+        }
+        if (config.inclusion == Inclusive && hasLowerLevels(&config)) {
+            printf("Back Invalidations: %ld\n", Cache[i].back_invalidations);
+        }
+        printf("\n");
+    }
+}
+
+// Totals of a run for a sweep table
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::summarize(sweep_result_t *result) {
+    for (int i = 0; i < config.num_cores; i++) {
+        const cache_t &c = Cache[i];
+        result->reads += c.memory_reads;
+        result->writes += c.memory_writes;
+        result->evictions += c.evictions;
+        result->bus_responses += c.response_bus;
+        result->interconnect_traffic += c.bus_traffic;
+        result->max_cycles = max(result->max_cycles, c.count);
+        result->total_cycles += c.count;
+        result->memory_fetches += c.memory_fetches;
+        result->memory_writebacks += c.memory_writebacks;
+        result->c2c_transfers += c.c2c_transfers;
+        result->bus_wait += c.bus_wait;
+        result->dram_wait += c.dram_wait;
+        result->remote_fetches += c.remote_fetches;
+        result->cross_socket += c.cross_socket;
+        if (has_l2) {
+            result->l2_hits += L2[i].hits;
+            result->l2_misses += L2[i].misses;
+        }
+    }
+    for (const vector<prefetcher_t> *pfs : {&l1_pf, &l2_pf}) {
+        for (const prefetcher_t &pf : *pfs) {
+            result->prefetches += pf.issued;
+            result->prefetch_useful += pf.useful;
+            result->prefetch_misses += pf.misses;
+        }
+    }
+    for (int s = 0; has_llc && s < config.sockets; s++) {
+        result->llc_hits += LLC[s].hits;
+        result->llc_misses += LLC[s].misses;
+    }
+    for (int s = 0; hasDRAM(&config) && s < config.sockets; s++) {
+        result->dram_row_hits += dram[s].outcomes[RowHit];
+        result->dram_requests += dram[s].reads + dram[s].writes;
+    }
+}
+
+// Advance every core by one round of the schedule (one read and one write
+// of the running task of its queue)
+// Returns 0 once every queue is done, -1 if a task's trace failed to load
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::runRound(vector<run_queue_t> &queues) {
+    int active = 0;
+
+    for (int core = 0; core < (int)queues.size(); core++) {
+        run_queue_t &queue = queues[core];
+        threadinfo_t *thread_info = queueTask(&queue);
+        if (thread_info == NULL) continue;
+        active = 1;
+
+        // Run Trace
+        runTaskTrace(core, thread_info);
+        if (threadFailed(thread_info)) {
+            return -1;
+        }
+        queueAdvance(&queue);
+    }
+
+    return active;
+}
+
+// Run the schedule in cycle order (engine = event)
+// The core with the smallest cycle count always takes the next step, so
+// accesses of different cores interleave (and meet on the bus) in the order
+// of their simulated times instead of one step per core per round. Time
+// jumps straight to the next core due: the instructions before an access of
+// an ordered trace are charged first and the access itself waits in
+// `pending` until the core comes up again, and cores whose queues are done
+// leave the heap. A core keeps running without touching the heap while it
+// is still the earliest. Returns -1 if a task's trace failed to load.
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::runEvents(vector<run_queue_t> &queues) {
+    core_events_t events;
+    CoreEventLater later;
+    vector<trace_access_t> pending(queues.size());
+    vector<char> has_pending(queues.size(), 0);
+
+    for (int core = 0; core < (int)queues.size(); core++) {
+        if (queueTask(&queues[core]) != NULL) {
+            events.push({Cache[core].count, core});
+        }
+    }
+
+    while (!events.empty()) {
+        core_event_t next = events.top();
+        events.pop();
+        int core = next.core;
+
+        // The core answered snoops since it was queued
+        if (next.cycle < Cache[core].count) {
+            events.push({Cache[core].count, core});
+            continue;
+        }
+
+        // Run the core until another one is due
+        run_queue_t &queue = queues[core];
+        while (1) {
+            threadinfo_t *thread_info = queueTask(&queue);
+
+            if (!threadOrdered(thread_info)) {
+                runTaskTrace(core, thread_info);
+                queueAdvance(&queue);
+            }
+            else if (!has_pending[core] && threadNextAccess(thread_info, &pending[core])) {
+                // The access waits for the core's clock to reach it
+                has_pending[core] = 1;
+                chargeInstructions(core, &pending[core]);
+            }
+            else {
+                if (collect_stats) statsTask(&stats, core, thread_info->thread_id);
+                if (has_pending[core]) {
+                    has_pending[core] = 0;
+                    runAccessLines(core, &pending[core]);
+                }
+                if (collect_stats) statsStep(&stats, core, Cache[core].count);
+                queueAdvance(&queue);
+            }
+            if (threadFailed(thread_info)) {
+                return -1;
             }
 
-            if (thread_info->read_list.size() == 0 &&
-                thread_info->write_list.size() == 0) {
-                CPU6.pop_back();
+            if (queueTask(&queue) == NULL) {
+                break;
+            }
+            core_event_t again = {Cache[core].count, core};
+            if (!events.empty() && later(again, events.top())) {
+                events.push(again);
+                break;
             }
         }
+    }
+    return 0;
+}
 
+// Simulate a schedule and print the statistics
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::run(const schedule_t &schedule) {
+    if (runSchedule(schedule) == -1) {
+        return -1;
     }
 
     printStats();
 
     return 0;
-}
\ No newline at end of file
+}
+
+// Simulate a schedule
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::runSchedule(const schedule_t &schedule) {
+
+    // Task scheduling, one run queue per core
+    vector<run_queue_t> queues;
+    if (buildRunQueues(schedule, &tasks, config.num_cores, queues) == -1) {
+        return -1;
+    }
+    sampleScales(queues, sample_scale, &total_sample_scale);
+
+    int ret;
+    if (config.engine == Sequential) {
+        while ((ret = runRound(queues)) == 1) {
+        }
+    }
+    else if (config.engine == Event) {
+        ret = runEvents(queues);
+    }
+    else if (runEpochs(queues) == -1) {
+        return -1;
+    }
+    else {
+        ret = 0;
+    }
+    if (ret == -1) {
+        // A truncated trace would print plausible but wrong statistics
+        printf("Trace replay stopped early, no statistics\n");
+        return -1;
+    }
+
+    // Requests still queued at the memory controller count as served
+    for (dram_t &node : dram) dramDrain(&node);
+
+    return 0;
+}
+
+// Run one epoch of a core on a worker thread
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::runCoreEpoch(int core, run_queue_t &queue, long first_round, long last_round) {
+
+    if (logging) {
+        saveCore(core, queue);
+    }
+
+    threadinfo_t *thread_info;
+    for (long round = first_round; round < last_round && (thread_info = queueTask(&queue)) != NULL; round++) {
+        engine[core].pos = accessPosition(round, core, config.num_cores);
+        runTaskTrace(core, thread_info);
+        queueAdvance(&queue);
+    }
+}
+
+// Checkpoint a core (caches, queue and the cursor of its current task)
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::saveCore(int core, const run_queue_t &queue) {
+    core_engine_t &e = engine[core];
+
+    e.saved = Cache[core];
+    if (has_l2) {
+        e.saved_l2 = L2[core];
+    }
+    e.saved_next = queue.next;
+
+    threadinfo_t *thread_info = queueTask(&queue);
+    if (thread_info != NULL) {
+        threadMark(thread_info, &e.saved_pos);
+    }
+}
+
+// Roll a core back to its checkpoint
+// Tasks started during the epoch had not run before it, so their cursors
+// go back to the start.
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::restoreCore(int core, run_queue_t &queue) {
+    core_engine_t &e = engine[core];
+
+    Cache[core] = e.saved;
+    if (has_l2) {
+        L2[core] = e.saved_l2;
+    }
+
+    for (size_t i = e.saved_next; i <= queue.next && i < queue.tasks.size(); i++) {
+        threadRewind(queue.tasks[i]);
+    }
+    queue.next = e.saved_next;
+
+    threadinfo_t *thread_info = queueTask(&queue);
+    if (thread_info != NULL) {
+        threadSeek(thread_info, &e.saved_pos);
+    }
+}
+
+// Record L1 activity of a speculative epoch
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::logEvent(int core, uint64_t line, int kind, int state) {
+    if (!logging) {
+        return;
+    }
+
+    core_engine_t &e = engine[core];
+    spec_event_t event = {e.pos, line, (uint8_t)kind, (uint8_t)state};
+    e.log.push_back(event);
+
+    // Fills and evictions are the only L1 events that change L2
+    if (kind == EventFill) {
+        e.last_fill[line & geom.set_mask()] = e.pos;
+    }
+    if (has_l2 && (kind == EventFill || kind == EventEvict)) {
+        e.last_l2[line & L2[core].set_mask] = e.pos;
+    }
+}
+
+// Group a core's log by line, keeping only lines that were posted on the bus
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::indexEvents(int core, const unordered_set<uint64_t> &lines) {
+    core_engine_t &e = engine[core];
+
+    e.events.clear();
+    for (const spec_event_t &event : e.log) {
+        if (lines.count(event.line)) {
+            e.events[event.line].push_back(event);
+        }
+    }
+}
+
+// L1 state of a line in a core just before position pos of the epoch
+// Taken from the latest of the core's own logged events and the override
+// left by an earlier resolved transaction, else from the checkpoint.
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::stateAt(int core, uint64_t line, long pos, const spec_override_t *ov) {
+    core_engine_t &e = engine[core];
+    int state = -1;
+    long when = -1;
+
+    auto it = e.events.find(line);
+    if (it != e.events.end()) {
+        for (const spec_event_t &event : it->second) {
+            if (event.pos >= pos) break;
+            if (event.kind == EventRead) continue;
+
+            state = event.kind == EventFill ? event.state : event.kind == EventWrite ? (int)StateM : (int)StateI;
+            when = event.pos;
+        }
+    }
+
+    // An override applies after the fill that posted it (same position)
+    if (ov != NULL && ov->pos >= when) {
+        return ov->state;
+    }
+    if (state != -1) {
+        return state;
+    }
+
+    long addr = (long)(line << geom.block_bits());
+    long base = decoder.set(addr) * geom.way_stride();
+    int i = findWay(geom, e.saved.tag[base / TAGS_PER_BLOCK].tag, decoder.tag(addr));
+    return i == -1 ? 0 : e.saved.state[base + i];
+}
+
+// Whether a core logged an event of one of kinds (bitmask) on line after pos
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::eventAfter(int core, uint64_t line, long pos, int kinds) {
+    auto it = engine[core].events.find(line);
+    if (it == engine[core].events.end()) {
+        return 0;
+    }
+    for (const spec_event_t &event : it->second) {
+        if (event.pos > pos && (kinds & (1 << event.kind))) return 1;
+    }
+    return 0;
+}
+
+// Resolve the transactions of a speculative epoch for the deterministic engine
+// Walks them in sequential order and works out what each would have done to
+// the other cores at that point. If that could have changed anything a core
+// did later in the epoch, returns 0 and the epoch is replayed; otherwise the
+// effects (downgrades, invalidations, counters) are applied and it returns 1.
+// Changes are made in place and undone by the rollback on failure. The
+// parallel engines only run MESI (see validateConfig).
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::validateEpoch(const vector<bus_msg_t> &msgs, long epoch_pos) {
+    const int any = (1 << EventRead) | (1 << EventWrite) | (1 << EventFill) | (1 << EventEvict);
+    const int write = 1 << EventWrite;
+    const int evict = 1 << EventEvict;
+    const int refill = (1 << EventFill) | (1 << EventEvict);
+
+    vector<unordered_map<uint64_t, spec_override_t>> overrides(config.num_cores);
+
+    for (const bus_msg_t &m : msgs) {
+        uint64_t line = decoder.line(m.addr);
+        int source = m.core;
+        int shared = 0;
+
+        Cache[source].bus_traffic += 1;
+
+        for (int i = 0; i < config.num_cores; i++) {
+            if (i == source) continue;
+
+            auto ov = overrides[i].find(line);
+            int state = stateAt(i, line, m.pos, ov == overrides[i].end() ? NULL : &ov->second);
+
+            if (m.op == BusRd) {
+                if (state == StateI) continue;
+                shared = 1;
+                Cache[i].count += 1;
+
+                if (state != StateS) {
+                    // Downgrade to Shared: a later silent write (or dirty
+                    // eviction) would have gone differently
+                    if (eventAfter(i, line, m.pos, state == StateM ? write | evict : write)) return 0;
+
+                    // Its flush writes the line back into the L2
+                    if (state == StateM && has_l2) return 0;
+
+                    Cache[i].response_bus += 1;
+                    if (state == StateM) Cache[i].bus_traffic += 1;
+                    overrides[i][line] = {m.pos, StateS};
+                }
+            }
+            else {
+                if (state != StateI) {
+                    // Invalidate: later use of the line, or a fill that could
+                    // have taken the freed way, would have gone differently
+                    if (eventAfter(i, line, m.pos, any) ||
+                        engine[i].last_fill[line & geom.set_mask()] > m.pos) return 0;
+
+                    Cache[i].count += 1;
+                    Cache[i].response_bus += 1;
+                    Cache[i].evictions += 1;
+                    if (state == StateM) Cache[i].bus_traffic += 1;
+                    overrides[i][line] = {m.pos, StateI};
+                }
+
+                // L2 copies: the line can only be there if it was at the
+                // checkpoint or passed through this core's L1 this epoch
+                if (has_l2 && (engine[i].events.count(line) ||
+                               levelFind(&engine[i].saved_l2, line) != -1)) {
+                    if (engine[i].last_l2[line & L2[i].set_mask] >= epoch_pos) return 0;
+
+                    int dirty;
+                    levelInvalidate(&L2[i], line, &dirty);
+                }
+            }
+        }
+
+        // The requester filled the line Exclusive; it should be Shared
+        if (m.op == BusRd && shared) {
+            if (eventAfter(source, line, m.pos, write)) return 0;
+            overrides[source][line] = {m.pos, StateS};
+        }
+    }
+
+    // Apply final states to lines that are still the instance they refer to
+    for (int i = 0; i < config.num_cores; i++) {
+        for (auto &entry : overrides[i]) {
+            uint64_t line = entry.first;
+            if (eventAfter(i, line, entry.second.pos, refill)) continue;
+
+            long addr = (long)(line << geom.block_bits());
+            L1_line_t l = getSet(i, decoder.set(addr));
+            int way = findWay(geom, l.tag, decoder.tag(addr));
+            if (way == -1) continue;
+
+            l.state[way] = entry.second.state;
+            if (entry.second.state == StateI) {
+                l.tag[way] = INVALID_TAG;
+            }
+        }
+    }
+
+    return 1;
+}
+
+// Resolve the transactions of an epoch for the parallel engine
+// Each is broadcast in sequential order against the end-of-epoch caches,
+// so coherence effects land up to one epoch late.
+template <class Geometry, class Policy>
+void Simulator<Geometry, Policy>::applyEpoch(const vector<bus_msg_t> &msgs) {
+    for (const bus_msg_t &m : msgs) {
+        int shared = BusTransaction(m.core, m.addr, (bus_op_t)m.op);
+
+        // The requester assumed no sharers when it filled the line
+        if (m.op == BusRd && shared) {
+            L1_line_t line = getSet(m.core, decoder.set(m.addr));
+            int i = findWay(geom, line.tag, decoder.tag(m.addr));
+            if (i != -1 && line.state[i] == StateE) {
+                line.state[i] = StateS;
+            }
+        }
+    }
+}
+
+// Run the schedule on the parallel engines
+// Every epoch, each core runs up to config.epoch rounds on a worker thread,
+// touching only its own caches and posting its bus transactions to its
+// outbox. At the barrier the outboxes are merged in sequential order and
+// resolved: applied as they are (parallel), or validated and applied
+// exactly (deterministic). An epoch that fails validation is rolled back
+// and replayed sequentially, and the epoch length adapts to the conflict
+// rate.
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::runEpochs(vector<run_queue_t> &queues) {
+
+    if (stream_trace) {
+        printf("The parallel engines cannot stream the trace\n");
+        return -1;
+    }
+
+    enum { PhaseStop, PhaseRun, PhaseIndex } phase = PhaseRun;
+
+    int deterministic = config.engine == Deterministic;
+    int threads = workerCount(config.threads, config.num_cores);
+    long round = 0;
+    long rounds = config.epoch;
+    unordered_set<uint64_t> lines;
+
+    epoch_barrier_t start, end;
+    barrierInit(&start, threads);
+    barrierInit(&end, threads);
+
+    // Cores are dealt round-robin to the workers
+    auto work = [&](int worker) {
+        for (int core = worker; core < config.num_cores; core += threads) {
+            if (phase == PhaseRun) runCoreEpoch(core, queues[core], round, round + rounds);
+            else indexEvents(core, lines);
+        }
+    };
+
+    vector<thread> workers;
+    for (int w = 1; w < threads; w++) {
+        workers.emplace_back([&, w] {
+            while (1) {
+                barrierWait(&start);
+                if (phase == PhaseStop) break;
+                work(w);
+                barrierWait(&end);
+            }
+        });
+    }
+
+    // Run a phase on every worker, the calling thread being worker 0
+    auto runPhase = [&](int next) {
+        phase = (decltype(phase))next;
+        barrierWait(&start);
+        work(0);
+        barrierWait(&end);
+    };
+
+    vector<bus_msg_t> msgs;
+
+    while (1) {
+        int active = 0;
+        for (const run_queue_t &queue : queues) active |= queueTask(&queue) != NULL;
+        if (!active) break;
+
+        speculative = 1;
+        logging = deterministic;
+        runPhase(PhaseRun);
+        speculative = 0;
+        logging = 0;
+
+        // Merge the outboxes into sequential order
+        msgs.clear();
+        for (core_engine_t &e : engine) {
+            msgs.insert(msgs.end(), e.outbox.begin(), e.outbox.end());
+            e.outbox.clear();
+        }
+        sort(msgs.begin(), msgs.end(),
+             [](const bus_msg_t &a, const bus_msg_t &b) { return a.pos < b.pos; });
+
+        int ok = 1;
+        if (deterministic) {
+            lines.clear();
+            for (const bus_msg_t &m : msgs) lines.insert(decoder.line(m.addr));
+            runPhase(PhaseIndex);
+
+            ok = validateEpoch(msgs, accessPosition(round, 0, config.num_cores));
+            for (core_engine_t &e : engine) e.log.clear();
+        }
+        else {
+            applyEpoch(msgs);
+        }
+
+        epochs += 1;
+
+        if (ok) {
+            round += rounds;
+            rounds = min(rounds * 2, (long)config.epoch);
+            continue;
+        }
+
+        // Conflict: roll back and replay the epoch on this thread
+        replays += 1;
+        for (int i = 0; i < config.num_cores; i++) {
+            restoreCore(i, queues[i]);
+        }
+        for (long last = round + rounds; round < last && runRound(queues); round++) {
+        }
+        rounds = max(rounds / 2, 1L);
+    }
+
+    phase = PhaseStop;
+    barrierWait(&start);
+    for (thread &worker : workers) {
+        worker.join();
+    }
+
+    return 0;
+}
+
+// Set/tag extraction as originally done on every access, kept for --bench
+static void legacyDecode(long linesize, long sets, long addr, long *set, long *tag) {
+    int L1_block_bits = log2(linesize);
+    int L1_idx_bits = log2(sets);
+    int L1_tag_bits = 64 - L1_idx_bits - L1_block_bits;
+
+    *set = (long)(((unsigned long)(addr << L1_tag_bits)) >> (L1_tag_bits + L1_block_bits));
+    *tag = (long)((unsigned long)addr >> (L1_idx_bits + L1_block_bits));
+}
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Microbenchmark of address decoding and cache accesses
+// Replays a synthetic strided read/write mix (one write per four accesses)
+// round-robin over the cores and reports accesses per second.
+template <class Geometry, class Policy>
+int Simulator<Geometry, Policy>::bench(long accesses) {
+
+    // Synthetic addresses: a few strided streams plus random noise
+    vector<long> addrs(1 << 16);
+    unsigned long seed = 12345;
+    for (size_t i = 0; i < addrs.size(); i++) {
+        seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+        long stream = i % 4;
+        addrs[i] = stream == 3 ? (long)((seed >> 20) & 0xffffff)
+                               : (long)(0x10000000 * (stream + 1) + 4 * i * (stream + 1));
+    }
+    size_t mask = addrs.size() - 1;
+
+    // Address decoding only
+    volatile long sink = 0;
+    long legacy_set, legacy_tag;
+
+    auto start = chrono::steady_clock::now();
+    for (long i = 0; i < accesses; i++) {
+        legacyDecode(geom.linesize(), geom.sets(), addrs[i & mask], &legacy_set, &legacy_tag);
+        sink = sink + legacy_set + legacy_tag;
+    }
+    double legacy_time = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    for (long i = 0; i < accesses; i++) {
+        long addr = addrs[i & mask];
+        sink = sink + decoder.set(addr) + decoder.tag(addr);
+    }
+    double decoder_time = secondsSince(start);
+
+    // Full cache accesses
+    start = chrono::steady_clock::now();
+    for (long i = 0; i < accesses; i++) {
+        int core = i % config.num_cores;
+        if (i % 4 == 3) processCacheWrite(core, addrs[i & mask]);
+        else processCacheRead(core, addrs[i & mask]);
+    }
+    double access_time = secondsSince(start);
+
+    printf("Accesses: %ld\n", accesses);
+    printf("Decode (log2):     %8.1f M/s\n", accesses / legacy_time / 1e6);
+    printf("Decode (decoder):  %8.1f M/s\n", accesses / decoder_time / 1e6);
+    printf("Cache accesses:    %8.1f M/s\n", accesses / access_time / 1e6);
+
+    // Scheduled replay: the same number of accesses split over more and more
+    // tasks (dealt round-robin to the cores) should keep its rate
+    long span = addrs.size() / 2;
+    printf("Scheduled replay:\n");
+    for (long ntasks = 100; ntasks <= 100000; ntasks *= 10) {
+        long per_task = min(max(accesses / ntasks / 2, 1L), span);
+
+        vector<threadinfo_t> storage(ntasks);
+        vector<threadinfo_t *> list;
+        schedule_t schedule;
+        schedule.cores.resize(config.num_cores);
+        for (long i = 0; i < ntasks; i++) {
+            threadinfo_t &t = storage[i];
+            t.thread_id = i;
+            t.read_list = &addrs[(i * 97) % span];
+            t.read_count = per_task;
+            t.write_list = &addrs[(i * 89) % span];
+            t.write_count = per_task;
+            list.push_back(&t);
+            schedule.cores[i % config.num_cores].push_back(i);
+        }
+
+        start = chrono::steady_clock::now();
+        vector<run_queue_t> queues;
+        buildTaskTable(list, &tasks);
+        buildRunQueues(schedule, &tasks, config.num_cores, queues);
+        double setup_time = secondsSince(start);
+
+        start = chrono::steady_clock::now();
+        while (runRound(queues)) {
+        }
+        double replay_time = secondsSince(start);
+
+        printf("  %6ld tasks:     %8.1f M/s (setup %.2f ms)\n", ntasks,
+               2 * per_task * ntasks / replay_time / 1e6, setup_time * 1e3);
+    }
+    buildTaskTable(thread_list, &tasks);
+
+    return 0;
+}
+
+// Call fn with a (null) pointer to the L1 specialization of a configuration
+template <class Fn>
+int withGeometry(const sim_config_t &config, Fn fn) {
+    long size = config.l1_size;
+    int assoc = config.l1_assoc;
+    int linesize = config.l1_linesize;
+
+    if (size == 32768 && assoc == 8 && linesize == 64) {
+        return fn((FixedGeometry<32768, 8, 64> *)NULL);
+    }
+    if (size == 49152 && assoc == 12 && linesize == 64) {
+        return fn((FixedGeometry<49152, 12, 64> *)NULL);
+    }
+    if (size == 65536 && assoc == 8 && linesize == 64) {
+        return fn((FixedGeometry<65536, 8, 64> *)NULL);
+    }
+    return fn((DynamicGeometry *)NULL);
+}
+
+// Call fn with a (null) pointer to the L1 replacement policy of a configuration
+template <class Fn>
+int withPolicy(const sim_config_t &config, Fn fn) {
+    switch (config.replacement) {
+    case ReplacePLRU:
+        return fn((TreePLRUPolicy *)NULL);
+    case ReplaceSRRIP:
+        return fn((SRRIPPolicy *)NULL);
+    case ReplaceBRRIP:
+        return fn((BRRIPPolicy *)NULL);
+    case ReplaceRandom:
+        return fn((RandomPolicy *)NULL);
+    default:
+        return fn((LRUPolicy *)NULL);
+    }
+}
+
+// Call fn with a simulator of a configuration, specialized for its L1
+// geometry and replacement policy
+template <class Fn>
+int withSimulator(const sim_config_t &config, Fn fn) {
+    return withGeometry(config, [&](auto *geom) {
+        return withPolicy(config, [&](auto *policy) {
+            Simulator<typename remove_pointer<decltype(geom)>::type,
+                      typename remove_pointer<decltype(policy)>::type> sim(config);
+            return fn(sim);
+        });
+    });
+}
+
+// Simulate a schedule on a configuration (or benchmark the configuration,
+// if bench_accesses is set)
+int simulate(const sim_config_t &config, long bench_accesses, const schedule_t &schedule) {
+    return withSimulator(config, [&](auto &sim) {
+        if (bench_accesses > 0) {
+            return sim.bench(bench_accesses);
+        }
+        if (stats_path == NULL && timeline_path == NULL && !classify_misses) {
+            return sim.run(schedule);
+        }
+
+        FILE *timeline = NULL;
+        if (timeline_path != NULL && (timeline = fopen(timeline_path, "w")) == NULL) {
+            printf("Error Opening Timeline File!\n");
+            return -1;
+        }
+        sim.collectStats(timeline, timeline_interval);
+
+        int ret = sim.run(schedule);
+        if (timeline != NULL && fclose(timeline) != 0) ret = -1;
+        if (ret == 0 && stats_path != NULL) ret = sim.writeStats(stats_path);
+        return ret;
+    });
+}
+
+// Simulate one run of a sweep on private cursors over the loaded trace
+void sweepRun(sweep_result_t *run) {
+    vector<threadinfo_t *> views;
+    for (threadinfo_t *t : thread_list) {
+        views.push_back(threadView(t));
+    }
+
+    auto start = chrono::steady_clock::now();
+    run->status = withSimulator(run->config, [&](auto &sim) {
+        sim.useThreads(views);
+        int ret = sim.runSchedule(*run->schedule);
+        sim.summarize(run);
+        return ret;
+    });
+    run->seconds = secondsSince(start);
+
+    for (threadinfo_t *view : views) {
+        deleteThread(view);
+    }
+}
+
+// Simulate every schedule against every combination of a sweep file (or
+// just the base configuration if path is NULL) on the loaded trace
+// Runs are spread over jobs threads (0 = one per host CPU) and written as
+// one table, JSON if output ends in .json, else CSV (stdout if no output).
+int runSweep(const sim_config_t &base, const char *path, const vector<schedule_t> &schedules,
+             int jobs, const char *output) {
+    vector<sweep_param_t> params;
+    vector<sweep_result_t> configs;
+
+    if (path != NULL && readSweepFile(path, params) == -1) {
+        return -1;
+    }
+    if (expandSweep(base, params, configs) == -1) {
+        return -1;
+    }
+
+    // Schedules are the outermost parameter
+    vector<sweep_result_t> runs;
+    for (const schedule_t &schedule : schedules) {
+        for (sweep_result_t run : configs) {
+            if (checkSchedule(schedule, run.config.num_cores) == -1) {
+                return -1;
+            }
+            run.schedule = &schedule;
+            if (schedules.size() > 1) {
+                run.values.insert(run.values.begin(), schedule.name);
+            }
+            runs.push_back(run);
+        }
+    }
+    if (schedules.size() > 1) {
+        sweep_param_t param;
+        param.key = "schedule";
+        params.insert(params.begin(), param);
+    }
+
+    int threads = workerCount(jobs, runs.size());
+    printf("Sweep: %zu runs on %d threads\n", runs.size(), threads);
+
+    // Workers take the next pending run until none are left
+    atomic<size_t> next(0);
+    auto work = [&] {
+        size_t i;
+        while ((i = next++) < runs.size()) {
+            sweepRun(&runs[i]);
+        }
+    };
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (int w = 1; w < threads; w++) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (thread &worker : workers) {
+        worker.join();
+    }
+    printf("Sweep time: %.2f s\n", secondsSince(start));
+
+    FILE *out = stdout;
+    if (output != NULL && (out = fopen(output, "w")) == NULL) {
+        printf("Error Opening Output File!\n");
+        return -1;
+    }
+
+    size_t len = output != NULL ? strlen(output) : 0;
+    if (len >= 5 && strcmp(output + len - 5, ".json") == 0) {
+        writeSweepJSON(out, params, runs);
+    }
+    else {
+        writeSweepCSV(out, params, runs);
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    for (const sweep_result_t &run : runs) {
+        if (run.status != 0) return -1;
+    }
+    return 0;
+}
+
+// Print Usage
+void printUsage(const char *prog) {
+    printf("Usage: %s [options] <trace file>...\n", prog);
+    printf("  --stream          page the trace in from disk instead of loading it\n");
+    printf("                    (binary traces only)\n");
+    printf("  --window <bytes>  resident trace window in streaming mode (default %ld)\n",
+           stream_window);
+    printf("  --schedule <file> task to core schedule(s), as printed by the schedulers'\n");
+    printf("                    get_schedule(); several are simulated as a batch\n");
+    printf("                    (default: the built-in 7 core matmul schedule)\n");
+    printf("  --config <file>   read cache parameters from a key = value file\n");
+    printf("  --set key=value   override a single parameter, e.g. --set l1_assoc=4\n");
+    printf("  --bench <n>       run n synthetic accesses and report throughput\n");
+    printf("                    (no trace file needed)\n");
+    printf("  --sweep <file>    simulate every combination of the parameter lists in\n");
+    printf("                    file against one load of the trace\n");
+    printf("  --jobs <n>        sweep runs simulated at once (default one per CPU)\n");
+    printf("  --output <file>   sweep table, JSON if it ends in .json, else CSV\n");
+    printf("  --stats <file>    per core, task and L1 set hits, classified misses,\n");
+    printf("                    invalidations and flushes, JSON if it ends in .json,\n");
+    printf("                    else CSV\n");
+    printf("  --timeline <file> the same counts per core every --interval steps (CSV)\n");
+    printf("  --interval <n>    steps per timeline row (default %ld)\n", timeline_interval);
+    printf("  --classify        print hits and cold / capacity / conflict / coherence\n");
+    printf("                    misses per core (implied by --stats and --timeline)\n");
+}
+
+int main(int argc, char *argv[]) {
+
+    static struct option long_options[] = {
+        {"stream", no_argument,       0, 's'},
+        {"window", required_argument, 0, 'w'},
+        {"config", required_argument, 0, 'c'},
+        {"schedule", required_argument, 0, 'r'},
+        {"set",    required_argument, 0, 'o'},
+        {"bench",  required_argument, 0, 'b'},
+        {"sweep",  required_argument, 0, 'S'},
+        {"jobs",   required_argument, 0, 'j'},
+        {"output", required_argument, 0, 'O'},
+        {"stats",  required_argument, 0, 'T'},
+        {"timeline", required_argument, 0, 'L'},
+        {"interval", required_argument, 0, 'I'},
+        {"classify", no_argument,     0, 'C'},
+        {"help",   no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    sim_config_t config;
+    initConfig(&config);
+
+    // Config file first, then --set overrides in order
+    vector<const char *> overrides;
+    long bench_accesses = 0;
+    const char *sweep_path = NULL;
+    vector<schedule_t> schedules;
+    const char *output_path = NULL;
+    int jobs = 0;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "sw:c:r:o:b:S:j:O:T:L:I:Ch", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 's':
+            stream_trace = 1;
+            break;
+        case 'w':
+            stream_window = strtol(optarg, NULL, 10);
+            if (stream_window <= 0) {
+                printf("Invalid window size: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'c':
+            if (readConfigFile(&config, optarg) == -1) {
+                return -1;
+            }
+            break;
+        case 'r':
+            if (readScheduleFile(optarg, schedules) == -1) {
+                return -1;
+            }
+            break;
+        case 'o':
+            overrides.push_back(optarg);
+            break;
+        case 'b':
+            bench_accesses = strtol(optarg, NULL, 10);
+            break;
+        case 'S':
+            sweep_path = optarg;
+            break;
+        case 'j':
+            jobs = strtol(optarg, NULL, 10);
+            break;
+        case 'O':
+            output_path = optarg;
+            break;
+        case 'T':
+            stats_path = optarg;
+            break;
+        case 'L':
+            timeline_path = optarg;
+            break;
+        case 'C':
+            classify_misses = 1;
+            break;
+        case 'I':
+            timeline_interval = strtol(optarg, NULL, 10);
+            if (timeline_interval <= 0) {
+                printf("Invalid interval: %s\n", optarg);
+                return -1;
+            }
+            break;
+        default:
+            printUsage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (bench_accesses > 0 ? optind != argc : optind == argc) {
+        printUsage(argv[0]);
+        return -1;
+    }
+
+    for (const char *assignment : overrides) {
+        if (setConfigAssignment(&config, assignment) == -1) {
+            return -1;
+        }
+    }
+
+    if (validateConfig(&config) == -1) {
+        return -1;
+    }
+    if (schedules.empty()) {
+        schedules.push_back(defaultSchedule());
+    }
+
+    // Several schedules or configurations are simulated as a batch
+    int batch = sweep_path != NULL || schedules.size() > 1;
+    if (batch && stream_trace) {
+        printf("--sweep and schedule batches need the whole trace loaded (no --stream)\n");
+        return -1;
+    }
+    if ((stats_path != NULL || timeline_path != NULL || classify_misses) &&
+        (batch || parallelEngine(&config))) {
+        printf("--stats, --timeline and --classify need a single run of engine = sequential or event\n");
+        return -1;
+    }
+
+    if (!batch) {
+        printConfig(&config);
+    }
+
+    if (bench_accesses > 0) {
+        return simulate(config, bench_accesses, schedules[0]);
+    }
+
+    // Parse memory trace
+    int active_cores = 0;
+    for (const schedule_t &schedule : schedules) {
+        active_cores = max(active_cores, scheduleCores(schedule));
+    }
+    vector<const char *> trace_paths(argv + optind, argv + argc);
+    if (parseTrace(trace_paths, max(active_cores, 1)) == -1) {
+        return -1;
+    }
+
+    // Run simulation
+    int ret;
+    if (batch) {
+        ret = runSweep(config, sweep_path, schedules, jobs, output_path);
+    }
+    else {
+        ret = checkSchedule(schedules[0], config.num_cores) == -1 ? -1
+                                                                 : simulate(config, 0, schedules[0]);
+    }
+
+    for (trace_map_t &map : trace_maps) {
+        unmapBinaryTrace(&map);
+    }
+    for (int fd : trace_fds) {
+        close(fd);
+    }
+
+    return ret;
+}
\ No newline at end of file
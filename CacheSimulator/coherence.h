@@ -0,0 +1,97 @@
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include <stdint.h>
+
+// Table-driven L1 coherence protocols
+//
+// A protocol is described by what a cache does when it snoops another
+// core's BusRd or BusRdX in each state, which state a fill enters, and
+// which states need a BusRdX on a write hit or a writeback on eviction:
+//
+//   MESI   clean lines are supplied by the level below; a Modified line is
+//          flushed (written back) when another core reads or writes it
+//   MOESI  a Modified line read by another core becomes Owned and keeps the
+//          dirty data (no flush), and M / O / E copies supply the data
+//          directly (cache-to-cache transfer)
+//   MESIF  the most recent reader of a shared line holds it in Forward and
+//          supplies the next reader, as do E and M copies
+//
+// State values are stored in the L1 and in the parallel engines' logs.
+
+typedef enum
+{
+    StateI,         // Invalid
+    StateS,         // Shared
+    StateE,         // Exclusive
+    StateM,         // Modified
+    StateO,         // Owned (MOESI)
+    StateF,         // Forward (MESIF)
+    COH_STATES
+} coh_state_t;
+
+typedef enum
+{
+    ProtocolMESI,
+    ProtocolMOESI,
+    ProtocolMESIF
+} protocol_t;
+
+// What a snooping cache does
+#define SNOOP_RESPOND 1     // Counts as a bus response
+#define SNOOP_FLUSH   2     // Writes its dirty copy back (Flush on the bus, and to
+                            // the lower levels if the next state is clean)
+#define SNOOP_SUPPLY  4     // Sends the line to the requester
+
+// Outcome of a bus transaction for the requester
+#define SNOOP_FOUND    1    // Another cache held the line
+#define SNOOP_SUPPLIED 2    // and sent it (cache-to-cache transfer)
+#define SNOOP_CROSS    4    // A cache on another socket held the line
+#define SNOOP_REMOTE   8    // and sent it
+
+typedef struct {
+    uint8_t next;           // State after the snoop
+    uint8_t flags;          // SNOOP_*
+} coh_snoop_t;
+
+typedef struct {
+    const char *name;
+    coh_snoop_t bus_rd[COH_STATES];     // Another core reads the line
+    coh_snoop_t bus_rdx[COH_STATES];    // Another core writes the line
+    uint8_t fill_shared;                // Read miss, other copies exist
+    uint8_t fill_alone;                 // Read miss, no other copy
+    uint8_t upgrade[COH_STATES];        // A write hit needs a BusRdX
+    uint8_t dirty[COH_STATES];          // Written back when evicted
+} coh_protocol_t;
+
+#define R SNOOP_RESPOND
+#define W SNOOP_FLUSH
+#define D SNOOP_SUPPLY
+
+//                 I              S              E                M                    O                F
+static const coh_protocol_t coh_protocols[] = {
+    {"MESI",
+     {{StateI, 0}, {StateS, 0}, {StateS, R},     {StateS, R | W},     {StateI, 0},     {StateI, 0}},
+     {{StateI, 0}, {StateI, R}, {StateI, R},     {StateI, R | W},     {StateI, 0},     {StateI, 0}},
+     StateS, StateE,
+     {0, 1, 0, 0, 0, 0},
+     {0, 0, 0, 1, 0, 0}},
+    {"MOESI",
+     {{StateI, 0}, {StateS, 0}, {StateS, R | D}, {StateO, R | D},     {StateO, R | D}, {StateI, 0}},
+     {{StateI, 0}, {StateI, R}, {StateI, R | D}, {StateI, R | D},     {StateI, R | D}, {StateI, 0}},
+     StateS, StateE,
+     {0, 1, 0, 0, 1, 0},
+     {0, 0, 0, 1, 1, 0}},
+    {"MESIF",
+     {{StateI, 0}, {StateS, 0}, {StateS, R | D}, {StateS, R | W | D}, {StateI, 0},     {StateS, R | D}},
+     {{StateI, 0}, {StateI, R}, {StateI, R | D}, {StateI, R | W | D}, {StateI, 0},     {StateI, R | D}},
+     StateF, StateE,
+     {0, 1, 0, 0, 0, 1},
+     {0, 0, 0, 1, 0, 0}},
+};
+
+#undef R
+#undef W
+#undef D
+
+#endif
@@ -0,0 +1,580 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "bus.h"
+#include "coherence.h"
+#include "dram.h"
+#include "hierarchy.h"
+#include "parallel.h"
+#include "prefetch.h"
+#include "replacement.h"
+using namespace std;
+
+// Page to memory node placement (sockets > 1)
+typedef enum
+{
+    FirstTouch,     // A page lives on the socket of the first core to miss on it
+    Interleave      // Pages alternate between the sockets
+} placement_t;
+
+// Simulation engine
+typedef enum
+{
+    Sequential,     // One host thread, cores interleaved round-robin
+    Parallel,       // Cores on worker threads, coherence resolved per epoch
+    Deterministic,  // Parallel, validated to match Sequential exactly
+    Event           // One host thread, the core furthest behind in cycles runs next
+} engine_t;
+
+// Simulator Configuration
+//
+// Set from a config file of "key = value" lines (# starts a comment) and
+// from --set key=value on the command line, in that order.
+typedef struct {
+    long l1_size;            // L1 data cache size in bytes
+    int  l1_assoc;           // L1 ways per set
+    int  l1_linesize;        // L1 line size in bytes
+    replacement_t replacement; // L1 replacement policy
+    prefetcher_kind_t l1_prefetcher; // Prefetcher of each L1
+    prefetcher_kind_t l2_prefetcher; // Prefetcher of each L2
+    int  prefetch_degree;    // Lines prefetched per trigger
+    int  prefetch_table;     // Stride table entries / stream trackers
+    int  num_cores;          // Simulated cores
+    int  sockets;            // Sockets the cores are split over (in order)
+    placement_t numa_placement; // Memory node of each page
+    long numa_page_size;     // Page size in bytes
+    int  numa_link_latency;  // Cycles for a line crossing the inter-socket link
+    int  numa_link_bandwidth; // Link bytes per cycle, 0 for a link without contention
+    int  l1_miss_penalty;    // Cycles charged for an L1 miss
+    int  instr_cycles;       // Cycles per non-memory instruction (ordered traces)
+    int  directory;          // Probe only sharers listed in a directory
+    protocol_t protocol;     // L1 coherence protocol
+    int  c2c_latency;        // Cycles for an L1 miss supplied by another L1
+    int  bus_bandwidth;      // Bus bytes per cycle, 0 for a bus without contention
+    arbitration_t bus_arbitration; // Order of queued bus requests
+    int  bus_rd_cycles;      // Bus occupancy of a BusRd / BusRdX / Flush
+    int  bus_rdx_cycles;     // before the line itself (linesize / bus_bandwidth)
+    int  bus_flush_cycles;
+    long l2_size;            // Private L2 size in bytes, 0 for none
+    int  l2_assoc;           // L2 ways per set
+    int  l2_latency;         // Cycles for an L1 miss that hits in L2
+    long llc_size;           // Shared LLC size in bytes, 0 for none
+    int  llc_assoc;          // LLC ways per set
+    int  llc_latency;        // Cycles for an L1 miss that hits in the LLC
+    int  memory_latency;     // Cycles for a miss in every level
+    int  dram_channels;      // Memory channels, 0 for a fixed memory latency
+    int  dram_banks;         // Banks per channel
+    long dram_row_size;      // Row (page) size in bytes
+    page_policy_t dram_page; // Open or closed page
+    int  dram_queue;         // Request queue entries per channel
+    int  dram_cas;           // Column access, activate and precharge cycles
+    int  dram_rcd;
+    int  dram_rp;
+    int  dram_burst;         // Cycles to transfer a line
+    inclusion_t inclusion;   // Inclusion policy of L2 / LLC
+    engine_t engine;         // Simulation engine
+    int  threads;            // Worker threads of the parallel engines, 0 = one per CPU
+    int  epoch;              // Rounds per epoch of the parallel engines
+} sim_config_t;
+
+// Default configuration (32K / 8-way / 64B L1, 8 cores)
+inline void initConfig(sim_config_t *config) {
+    config->l1_size = 32768;
+    config->l1_assoc = 8;
+    config->l1_linesize = 64;
+    config->replacement = ReplaceLRU;
+    config->l1_prefetcher = PrefetchNone;
+    config->l2_prefetcher = PrefetchNone;
+    config->prefetch_degree = 2;
+    config->prefetch_table = 64;
+    config->num_cores = 8;
+    config->sockets = 1;
+    config->numa_placement = FirstTouch;
+    config->numa_page_size = 4096;
+    config->numa_link_latency = 60;
+    config->numa_link_bandwidth = 0;
+    config->l1_miss_penalty = 10;
+    config->instr_cycles = 1;
+    config->directory = 0;
+    config->protocol = ProtocolMESI;
+    config->c2c_latency = 10;
+    config->bus_bandwidth = 0;
+    config->bus_arbitration = ArbitrationFCFS;
+    config->bus_rd_cycles = 1;
+    config->bus_rdx_cycles = 1;
+    config->bus_flush_cycles = 1;
+    config->l2_size = 0;
+    config->l2_assoc = 4;
+    config->l2_latency = 12;
+    config->llc_size = 0;
+    config->llc_assoc = 16;
+    config->llc_latency = 40;
+    config->memory_latency = 200;
+    config->dram_channels = 0;
+    config->dram_banks = 8;
+    config->dram_row_size = 8192;
+    config->dram_page = PageOpen;
+    config->dram_queue = 32;
+    config->dram_cas = 40;
+    config->dram_rcd = 40;
+    config->dram_rp = 40;
+    config->dram_burst = 8;
+    config->inclusion = NINE;
+    config->engine = Sequential;
+    config->threads = 0;
+    config->epoch = 1024;
+}
+
+// Whether cores run on worker threads in epochs
+inline int parallelEngine(const sim_config_t *config) {
+    return config->engine == Parallel || config->engine == Deterministic;
+}
+
+// Whether any level below L1 is simulated
+// Without one, every L1 miss costs l1_miss_penalty.
+inline int hasLowerLevels(const sim_config_t *config) {
+    return config->l2_size > 0 || config->llc_size > 0;
+}
+
+// Whether the cores are split over several sockets (NUMA)
+inline int hasSockets(const sim_config_t *config) {
+    return config->sockets > 1;
+}
+
+// Whether memory is timed by the DRAM model (dram.h) instead of
+// memory_latency, or l1_miss_penalty without lower levels
+inline int hasDRAM(const sim_config_t *config) {
+    return config->dram_channels > 0;
+}
+
+// Decimal, or hex with an explicit 0x (a leading 0 is not octal)
+static inline int parseLong(const char *value, long *out) {
+    char *end;
+    int hex = value[0] == '0' && (value[1] == 'x' || value[1] == 'X');
+    errno = 0;
+    *out = strtol(value, &end, hex ? 16 : 10);
+    if (end == value || errno == ERANGE) return -1;
+
+    // Allow K / M suffixes for sizes
+    int shift = 0;
+    if (*end == 'K' || *end == 'k') shift = 10;
+    else if (*end == 'M' || *end == 'm') shift = 20;
+    if (shift > 0) {
+        if (*out > (LONG_MAX >> shift) || *out < (LONG_MIN >> shift)) return -1;
+        *out *= 1L << shift;
+        end++;
+    }
+    return *end == '\0' ? 0 : -1;
+}
+
+// Set a single configuration value
+// Returns -1 for unknown keys or malformed values
+inline int setConfigValue(sim_config_t *config, const char *key, const char *value) {
+
+    // String valued keys
+    if (strcmp(key, "inclusion") == 0) {
+        if (strcmp(value, "inclusive") == 0) config->inclusion = Inclusive;
+        else if (strcmp(value, "exclusive") == 0) config->inclusion = Exclusive;
+        else if (strcmp(value, "nine") == 0) config->inclusion = NINE;
+        else {
+            printf("Invalid value for %s: %s (inclusive, exclusive or nine)\n", key, value);
+            return -1;
+        }
+        return 0;
+    }
+    if (strcmp(key, "replacement") == 0) {
+        if (strcmp(value, "lru") == 0) config->replacement = ReplaceLRU;
+        else if (strcmp(value, "plru") == 0) config->replacement = ReplacePLRU;
+        else if (strcmp(value, "srrip") == 0) config->replacement = ReplaceSRRIP;
+        else if (strcmp(value, "brrip") == 0) config->replacement = ReplaceBRRIP;
+        else if (strcmp(value, "random") == 0) config->replacement = ReplaceRandom;
+        else {
+            printf("Invalid value for %s: %s (lru, plru, srrip, brrip or random)\n", key, value);
+            return -1;
+        }
+        return 0;
+    }
+    if (strcmp(key, "l1_prefetcher") == 0 || strcmp(key, "l2_prefetcher") == 0) {
+        prefetcher_kind_t *kind = key[1] == '1' ? &config->l1_prefetcher : &config->l2_prefetcher;
+        if (strcmp(value, "none") == 0) *kind = PrefetchNone;
+        else if (strcmp(value, "next_line") == 0) *kind = PrefetchNextLine;
+        else if (strcmp(value, "stride") == 0) *kind = PrefetchStride;
+        else if (strcmp(value, "stream") == 0) *kind = PrefetchStream;
+        else {
+            printf("Invalid value for %s: %s (none, next_line, stride or stream)\n", key, value);
+            return -1;
+        }
+        return 0;
+    }
+    if (strcmp(key, "protocol") == 0) {
+        if (strcmp(value, "mesi") == 0) config->protocol = ProtocolMESI;
+        else if (strcmp(value, "moesi") == 0) config->protocol = ProtocolMOESI;
+        else if (strcmp(value, "mesif") == 0) config->protocol = ProtocolMESIF;
+        else {
+            printf("Invalid value for %s: %s (mesi, moesi or mesif)\n", key, value);
+            return -1;
+        }
+        return 0;
+    }
+    if (strcmp(key, "bus_arbitration") == 0) {
+        if (strcmp(value, "fcfs") == 0) config->bus_arbitration = ArbitrationFCFS;
+        else if (strcmp(value, "rr") == 0) config->bus_arbitration = ArbitrationRR;
+        else {
+            printf("Invalid value for %s: %s (fcfs or rr)\n", key, value);
+            return -1;
+        }
+        return 0;
+    }
+    if (strcmp(key, "dram_page") == 0) {
+        if (strcmp(value, "open") == 0) config->dram_page = PageOpen;
+        else if (strcmp(value, "closed") == 0) config->dram_page = PageClosed;
+        else {
+            printf("Invalid value for %s: %s (open or closed)\n", key, value);
+            return -1;
+        }
+        return 0;
+    }
+    if (strcmp(key, "numa_placement") == 0) {
+        if (strcmp(value, "first_touch") == 0) config->numa_placement = FirstTouch;
+        else if (strcmp(value, "interleave") == 0) config->numa_placement = Interleave;
+        else {
+            printf("Invalid value for %s: %s (first_touch or interleave)\n", key, value);
+            return -1;
+        }
+        return 0;
+    }
+    if (strcmp(key, "engine") == 0) {
+        if (strcmp(value, "sequential") == 0) config->engine = Sequential;
+        else if (strcmp(value, "parallel") == 0) config->engine = Parallel;
+        else if (strcmp(value, "deterministic") == 0) config->engine = Deterministic;
+        else if (strcmp(value, "event") == 0) config->engine = Event;
+        else {
+            printf("Invalid value for %s: %s (sequential, event, parallel or deterministic)\n", key, value);
+            return -1;
+        }
+        return 0;
+    }
+
+    long v;
+    if (parseLong(value, &v) == -1) {
+        printf("Invalid value for %s: %s\n", key, value);
+        return -1;
+    }
+
+    long *long_field = NULL;
+    int  *int_field = NULL;
+
+    if (strcmp(key, "l1_size") == 0) long_field = &config->l1_size;
+    else if (strcmp(key, "l1_assoc") == 0) int_field = &config->l1_assoc;
+    else if (strcmp(key, "l1_linesize") == 0) int_field = &config->l1_linesize;
+    else if (strcmp(key, "num_cores") == 0) int_field = &config->num_cores;
+    else if (strcmp(key, "prefetch_degree") == 0) int_field = &config->prefetch_degree;
+    else if (strcmp(key, "prefetch_table") == 0) int_field = &config->prefetch_table;
+    else if (strcmp(key, "sockets") == 0) int_field = &config->sockets;
+    else if (strcmp(key, "numa_page_size") == 0) long_field = &config->numa_page_size;
+    else if (strcmp(key, "numa_link_latency") == 0) int_field = &config->numa_link_latency;
+    else if (strcmp(key, "numa_link_bandwidth") == 0) int_field = &config->numa_link_bandwidth;
+    else if (strcmp(key, "l1_miss_penalty") == 0) int_field = &config->l1_miss_penalty;
+    else if (strcmp(key, "instr_cycles") == 0) int_field = &config->instr_cycles;
+    else if (strcmp(key, "directory") == 0) int_field = &config->directory;
+    else if (strcmp(key, "c2c_latency") == 0) int_field = &config->c2c_latency;
+    else if (strcmp(key, "bus_bandwidth") == 0) int_field = &config->bus_bandwidth;
+    else if (strcmp(key, "bus_rd_cycles") == 0) int_field = &config->bus_rd_cycles;
+    else if (strcmp(key, "bus_rdx_cycles") == 0) int_field = &config->bus_rdx_cycles;
+    else if (strcmp(key, "bus_flush_cycles") == 0) int_field = &config->bus_flush_cycles;
+    else if (strcmp(key, "l2_size") == 0) long_field = &config->l2_size;
+    else if (strcmp(key, "l2_assoc") == 0) int_field = &config->l2_assoc;
+    else if (strcmp(key, "l2_latency") == 0) int_field = &config->l2_latency;
+    else if (strcmp(key, "llc_size") == 0) long_field = &config->llc_size;
+    else if (strcmp(key, "llc_assoc") == 0) int_field = &config->llc_assoc;
+    else if (strcmp(key, "llc_latency") == 0) int_field = &config->llc_latency;
+    else if (strcmp(key, "memory_latency") == 0) int_field = &config->memory_latency;
+    else if (strcmp(key, "dram_channels") == 0) int_field = &config->dram_channels;
+    else if (strcmp(key, "dram_banks") == 0) int_field = &config->dram_banks;
+    else if (strcmp(key, "dram_row_size") == 0) long_field = &config->dram_row_size;
+    else if (strcmp(key, "dram_queue") == 0) int_field = &config->dram_queue;
+    else if (strcmp(key, "dram_cas") == 0) int_field = &config->dram_cas;
+    else if (strcmp(key, "dram_rcd") == 0) int_field = &config->dram_rcd;
+    else if (strcmp(key, "dram_rp") == 0) int_field = &config->dram_rp;
+    else if (strcmp(key, "dram_burst") == 0) int_field = &config->dram_burst;
+    else if (strcmp(key, "threads") == 0) int_field = &config->threads;
+    else if (strcmp(key, "epoch") == 0) int_field = &config->epoch;
+    else {
+        printf("Unknown configuration key: %s\n", key);
+        return -1;
+    }
+
+    if (int_field != NULL) {
+        if (v < INT_MIN || v > INT_MAX) {
+            printf("Invalid value for %s: %s\n", key, value);
+            return -1;
+        }
+        *int_field = v;
+    }
+    else {
+        *long_field = v;
+    }
+    return 0;
+}
+
+static inline string trimConfig(const string &s) {
+    size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+// Apply a "key=value" assignment
+inline int setConfigAssignment(sim_config_t *config, const char *assignment) {
+    string line(assignment);
+    size_t eq = line.find('=');
+    if (eq == string::npos) {
+        printf("Expected key=value, got: %s\n", assignment);
+        return -1;
+    }
+    string key = trimConfig(line.substr(0, eq));
+    string value = trimConfig(line.substr(eq + 1));
+    return setConfigValue(config, key.c_str(), value.c_str());
+}
+
+// Read a configuration file
+inline int readConfigFile(sim_config_t *config, const char *path) {
+    FILE *fptr = fopen(path, "r");
+    if (fptr == NULL) {
+        printf("Error Opening Config File!\n");
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t len = 0;
+    int ret = 0;
+
+    while (getline(&line, &len, fptr) != -1) {
+        char *comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+        if (trimConfig(line).empty()) continue;
+
+        if (setConfigAssignment(config, line) == -1) {
+            ret = -1;
+            break;
+        }
+    }
+
+    free(line);
+    fclose(fptr);
+    return ret;
+}
+
+static inline int isPowerOfTwo(long v) {
+    return v > 0 && (v & (v - 1)) == 0;
+}
+
+// Check the geometry of a lower level (size 0 disables it)
+static inline int validateLevel(const char *name, long size, int assoc, int linesize) {
+    if (size == 0) return 0;
+    if (assoc <= 0 || size % ((long)assoc * linesize) != 0 ||
+        !isPowerOfTwo(size / assoc / linesize)) {
+        printf("%s_size / (%s_assoc * l1_linesize) must be a power of two\n", name, name);
+        return -1;
+    }
+    return 0;
+}
+
+// Check that the configuration describes a buildable cache
+inline int validateConfig(const sim_config_t *config) {
+    if (!isPowerOfTwo(config->l1_linesize) || config->l1_linesize < 2) {
+        printf("l1_linesize must be a power of two of at least 2\n");
+        return -1;
+    }
+    if (config->l1_assoc <= 0 || config->l1_assoc > 64) {
+        printf("l1_assoc must be between 1 and 64\n");
+        return -1;
+    }
+    if (config->l1_size % ((long)config->l1_assoc * config->l1_linesize) != 0 ||
+        !isPowerOfTwo(config->l1_size / config->l1_assoc / config->l1_linesize)) {
+        printf("l1_size / (l1_assoc * l1_linesize) must be a power of two\n");
+        return -1;
+    }
+    if (config->replacement == ReplacePLRU && !isPowerOfTwo(config->l1_assoc)) {
+        printf("replacement = plru needs a power of two l1_assoc\n");
+        return -1;
+    }
+    if (config->num_cores <= 0) {
+        printf("num_cores must be positive\n");
+        return -1;
+    }
+    if (config->instr_cycles < 0) {
+        printf("instr_cycles must be non-negative\n");
+        return -1;
+    }
+    if (config->directory && config->num_cores > 64) {
+        printf("directory supports at most 64 cores\n");
+        return -1;
+    }
+    if (validateLevel("l2", config->l2_size, config->l2_assoc, config->l1_linesize) == -1 ||
+        validateLevel("llc", config->llc_size, config->llc_assoc, config->l1_linesize) == -1) {
+        return -1;
+    }
+    if (config->bus_bandwidth < 0 || config->bus_rd_cycles < 0 || config->bus_rdx_cycles < 0 ||
+        config->bus_flush_cycles < 0) {
+        printf("bus_bandwidth and the bus occupancies must be non-negative\n");
+        return -1;
+    }
+    if (config->bus_bandwidth > 0 && config->engine != Event) {
+        // Requests must reach the bus in cycle order
+        printf("bus_bandwidth needs engine = event\n");
+        return -1;
+    }
+    if (config->l1_prefetcher != PrefetchNone || config->l2_prefetcher != PrefetchNone) {
+        if (config->prefetch_degree <= 0 || config->prefetch_table <= 0) {
+            printf("prefetch_degree and prefetch_table must be positive\n");
+            return -1;
+        }
+        if (config->l2_prefetcher != PrefetchNone && config->l2_size == 0) {
+            printf("l2_prefetcher needs an L2 (l2_size)\n");
+            return -1;
+        }
+    }
+    if (config->sockets < 1 || config->num_cores % config->sockets) {
+        printf("sockets must be positive and divide num_cores\n");
+        return -1;
+    }
+    if (hasSockets(config)) {
+        if (config->numa_page_size < config->l1_linesize || config->numa_page_size % config->l1_linesize) {
+            printf("numa_page_size must be a multiple of l1_linesize\n");
+            return -1;
+        }
+        if (config->numa_link_latency < 0 || config->numa_link_bandwidth < 0) {
+            printf("numa_link_latency and numa_link_bandwidth must be non-negative\n");
+            return -1;
+        }
+        if (config->numa_link_bandwidth > 0 && config->engine != Event) {
+            printf("numa_link_bandwidth needs engine = event\n");
+            return -1;
+        }
+    }
+    if (config->dram_channels < 0) {
+        printf("dram_channels must be non-negative\n");
+        return -1;
+    }
+    if (hasDRAM(config)) {
+        if (config->dram_banks <= 0 || config->dram_queue <= 0) {
+            printf("dram_banks and dram_queue must be positive\n");
+            return -1;
+        }
+        if (config->dram_row_size < config->l1_linesize || config->dram_row_size % config->l1_linesize) {
+            printf("dram_row_size must be a multiple of l1_linesize\n");
+            return -1;
+        }
+        if (config->dram_cas < 0 || config->dram_rcd < 0 || config->dram_rp < 0 || config->dram_burst < 1) {
+            printf("DRAM timings must be non-negative and dram_burst positive\n");
+            return -1;
+        }
+        if (config->engine != Event) {
+            // Requests must reach the controller in cycle order
+            printf("dram_channels needs engine = event\n");
+            return -1;
+        }
+    }
+    if (parallelEngine(config)) {
+        // Shared structures are only modelled by the single-threaded engines
+        if (config->directory || config->llc_size > 0 || hasSockets(config)) {
+            printf("directory, llc_size and sockets need engine = sequential or event\n");
+            return -1;
+        }
+        if (config->l1_prefetcher != PrefetchNone || config->l2_prefetcher != PrefetchNone) {
+            printf("prefetchers need engine = sequential or event\n");
+            return -1;
+        }
+        // Epoch validation follows MESI
+        if (config->protocol != ProtocolMESI) {
+            printf("protocol = %s needs engine = sequential or event\n",
+                   config->protocol == ProtocolMOESI ? "moesi" : "mesif");
+            return -1;
+        }
+        if (config->epoch <= 0 || config->threads < 0) {
+            printf("epoch must be positive and threads non-negative\n");
+            return -1;
+        }
+    }
+    if (config->engine == Deterministic) {
+        // Every access must advance the core's clock so LRU stamps stay distinct
+        if (config->l1_miss_penalty < 1 || config->l2_latency < 1 || config->memory_latency < 1) {
+            printf("engine = deterministic needs latencies of at least 1 cycle\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+inline void printConfig(const sim_config_t *config) {
+    printf("L1: %ld bytes, %d-way, %d byte lines\n",
+           config->l1_size, config->l1_assoc, config->l1_linesize);
+    if (config->replacement != ReplaceLRU) {
+        const char *names[] = {"LRU", "tree PLRU", "SRRIP", "BRRIP", "random"};
+        printf("L1 replacement: %s\n", names[config->replacement]);
+    }
+    if (config->l1_prefetcher != PrefetchNone || config->l2_prefetcher != PrefetchNone) {
+        const char *names[] = {"none", "next-line", "stride", "stream"};
+        printf("Prefetchers: L1 %s, L2 %s, degree %d, %d table entries\n", names[config->l1_prefetcher],
+               names[config->l2_prefetcher], config->prefetch_degree, config->prefetch_table);
+    }
+    if (config->l2_size > 0) {
+        printf("L2: %ld bytes, %d-way, %d cycles (private)\n",
+               config->l2_size, config->l2_assoc, config->l2_latency);
+    }
+    if (config->llc_size > 0) {
+        printf("LLC: %ld bytes, %d-way, %d cycles (shared%s)\n",
+               config->llc_size, config->llc_assoc, config->llc_latency, hasSockets(config) ? " per socket" : "");
+    }
+    if (hasSockets(config)) {
+        printf("Sockets: %d x %d cores, %s placement of %ld byte pages, link %d cycles",
+               config->sockets, config->num_cores / config->sockets,
+               config->numa_placement == FirstTouch ? "first-touch" : "interleaved",
+               config->numa_page_size, config->numa_link_latency);
+        if (config->numa_link_bandwidth > 0) printf(", %d bytes per cycle", config->numa_link_bandwidth);
+        printf("\n");
+    }
+    if (hasLowerLevels(config)) {
+        const char *names[] = {"inclusive", "exclusive", "NINE"};
+        printf("Memory: %d cycles, %s hierarchy\n", config->memory_latency, names[config->inclusion]);
+    }
+    if (hasDRAM(config)) {
+        printf("DRAM%s: %d channels x %d banks, %ld byte rows, %s page, %d entry queues, "
+               "CAS %d / RCD %d / RP %d / burst %d cycles\n",
+               hasSockets(config) ? " (per socket)" : "", config->dram_channels, config->dram_banks, config->dram_row_size,
+               config->dram_page == PageOpen ? "open" : "closed", config->dram_queue,
+               config->dram_cas, config->dram_rcd, config->dram_rp, config->dram_burst);
+    }
+    if (config->engine == Event) {
+        printf("Engine: event-driven\n");
+    }
+    if (config->bus_bandwidth > 0) {
+        printf("Bus: %d bytes per cycle, %s arbitration, occupancy %d / %d / %d cycles + line\n",
+               config->bus_bandwidth, config->bus_arbitration == ArbitrationRR ? "round-robin" : "FCFS",
+               config->bus_rd_cycles, config->bus_rdx_cycles, config->bus_flush_cycles);
+    }
+    if (parallelEngine(config)) {
+        printf("Engine: %s, %d threads, %d rounds per epoch\n",
+               config->engine == Parallel ? "parallel" : "deterministic",
+               workerCount(config->threads, config->num_cores), config->epoch);
+    }
+    if (config->instr_cycles != 1) {
+        printf("Instruction cycles: %d\n", config->instr_cycles);
+    }
+    if (config->protocol != ProtocolMESI) {
+        printf("Coherence: %s, cache-to-cache transfers %d cycles\n",
+               coh_protocols[config->protocol].name, config->c2c_latency);
+    }
+    printf("Cores: %d, L1 miss penalty: %d%s\n\n",
+           config->num_cores, config->l1_miss_penalty,
+           config->directory ? ", sharer directory" : "");
+}
+
+#endif
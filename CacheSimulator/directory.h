@@ -0,0 +1,75 @@
+#ifndef DIRECTORY_H
+#define DIRECTORY_H
+
+#include <stdint.h>
+#include <unordered_map>
+using namespace std;
+
+// Sharer directory / snoop filter
+//
+// Tracks, for every cached line, a bitmask of the cores whose L1 holds it
+// (in any valid state). Bus transactions then only probe the cores in the
+// mask instead of broadcasting to every core. Entries are dropped as soon
+// as no core holds the line, so the directory never grows beyond the total
+// number of L1 lines. Supports up to 64 cores.
+#define DIRECTORY_MAX_CORES 64
+
+typedef struct {
+    unordered_map<long, uint64_t> sharers;  // Line address -> core bitmask
+    long lookups;                           // Bus transactions looked up
+    long hits;                              // Lookups with another sharer
+    long probes;                            // Caches actually probed
+    long probes_avoided;                    // Caches a broadcast would probe
+    long messages;                          // Request + forwarded probes
+} directory_t;
+
+inline void dirInit(directory_t *dir) {
+    dir->sharers.clear();
+    dir->lookups = 0;
+    dir->hits = 0;
+    dir->probes = 0;
+    dir->probes_avoided = 0;
+    dir->messages = 0;
+}
+
+// Record that core now holds line
+inline void dirAddSharer(directory_t *dir, long line, int core) {
+    dir->sharers[line] |= (uint64_t)1 << core;
+}
+
+// Record that core no longer holds line
+inline void dirRemoveSharer(directory_t *dir, long line, int core) {
+    auto it = dir->sharers.find(line);
+    if (it == dir->sharers.end()) return;
+
+    it->second &= ~((uint64_t)1 << core);
+    if (it->second == 0) dir->sharers.erase(it);
+}
+
+// Cores other than source that must be probed for line
+inline uint64_t dirLookup(directory_t *dir, long line, int source, int num_cores) {
+    uint64_t mask = 0;
+    auto it = dir->sharers.find(line);
+    if (it != dir->sharers.end()) mask = it->second & ~((uint64_t)1 << source);
+
+    int probes = __builtin_popcountll(mask);
+
+    dir->lookups += 1;
+    dir->hits += mask != 0;
+    dir->probes += probes;
+    dir->probes_avoided += (num_cores - 1) - probes;
+    dir->messages += 1 + probes;
+
+    return mask;
+}
+
+inline void dirPrintStats(const directory_t *dir) {
+    printf("Directory Lookups: %ld\n", dir->lookups);
+    printf("Directory Hit Rate: %.2f%%\n",
+           dir->lookups ? 100.0 * dir->hits / dir->lookups : 0.0);
+    printf("Probes Sent: %ld\n", dir->probes);
+    printf("Probes Avoided: %ld\n", dir->probes_avoided);
+    printf("Directory Messages: %ld\n\n", dir->messages);
+}
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef DRAM_H
+#define DRAM_H
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+using namespace std;
+
+// Memory controller and DRAM bank timing
+//
+// Lines that leave the last cache level are mapped to a channel, a bank and
+// a row (consecutive lines share a row, consecutive rows alternate between
+// channels, then banks). Each bank keeps its open row:
+//
+//   row hit       the row is open, column access only (t_cas)
+//   row empty     the bank is precharged, activate first (t_rcd + t_cas)
+//   row conflict  another row is open, precharge it too (t_rp + t_rcd + t_cas)
+//
+// followed by the burst that transfers the line (t_burst). Accesses to the
+// open row pipeline, one burst apart. The closed-page policy precharges
+// after every access, so every access is a row empty and the bank is busy
+// for t_rp afterwards.
+//
+// Requests are resolved as they are issued (in cycle order, by the event
+// engine), like the bus. Requests that have not started yet stay queued per
+// bank, and FR-FCFS scheduling lets a new request to the open row go ahead
+// of queued requests to other rows (pushing them back, their cores are
+// charged the extra wait) unless one of them was already bypassed
+// DRAM_BYPASS_CAP times. The controller holds at most `queue` requests per
+// channel; a request that finds it full waits for a slot.
+#define DRAM_BYPASS_CAP 16
+#define DRAM_NO_ROW (-1L)
+
+typedef enum
+{
+    PageOpen,       // Rows stay open until a conflict
+    PageClosed      // Rows are precharged after every access
+} page_policy_t;
+
+typedef enum
+{
+    RowHit,
+    RowEmpty,
+    RowConflict
+} row_outcome_t;
+
+typedef struct {
+    int  core;              // Requesting core, -1 for a writeback
+    long arrival;           // Cycle the request entered the queue
+    long issued;            // Cycle it was issued (before a full queue)
+    long row;
+    long start;             // Cycle the bank starts serving it
+    long done;              // Cycle the line has been transferred
+    long free;              // Cycle the bank can serve the next request
+    int  outcome;           // row_outcome_t
+    int  bypassed;          // Times a later row hit went ahead of it
+} dram_req_t;
+
+typedef struct {
+    long open_row;              // After the started requests, DRAM_NO_ROW if precharged
+    long free_at;               // Bank free after the started requests
+    deque<dram_req_t> queued;   // Served in this order, not started yet
+} dram_bank_t;
+
+// Extra wait charged to a core whose queued read was pushed back
+typedef struct {
+    int  core;
+    long cycles;
+} dram_push_t;
+
+typedef struct {
+    int  channels;
+    int  banks;                 // Per channel
+    long lines_per_row;
+    page_policy_t page;
+    int  queue;                 // Request queue entries per channel
+    int  t_cas, t_rcd, t_rp, t_burst;
+    vector<dram_bank_t> bank;   // Channel-major
+    vector<dram_push_t> pushed; // Filled by dramRequest
+    vector<long> starts;        // Scratch: start cycles of a channel's queue
+
+    long reads;
+    long writes;
+    long outcomes[3];           // Row hits / empties / conflicts
+    long read_cycles;           // Sum of read latencies
+    long max_read;
+    long queue_full;            // Requests that waited for a queue slot
+} dram_t;
+
+inline void dramInit(dram_t *dram, int channels, int banks, long lines_per_row, page_policy_t page,
+                     int queue, int t_cas, int t_rcd, int t_rp, int t_burst) {
+    dram->channels = channels;
+    dram->banks = banks;
+    dram->lines_per_row = lines_per_row;
+    dram->page = page;
+    dram->queue = queue;
+    dram->t_cas = t_cas;
+    dram->t_rcd = t_rcd;
+    dram->t_rp = t_rp;
+    dram->t_burst = t_burst;
+
+    dram_bank_t idle;
+    idle.open_row = DRAM_NO_ROW;
+    idle.free_at = 0;
+    dram->bank.assign((size_t)channels * banks, idle);
+    dram->pushed.clear();
+
+    dram->reads = 0;
+    dram->writes = 0;
+    dram->outcomes[RowHit] = dram->outcomes[RowEmpty] = dram->outcomes[RowConflict] = 0;
+    dram->read_cycles = 0;
+    dram->max_read = 0;
+    dram->queue_full = 0;
+}
+
+// Count a request whose latency is final
+static inline void dramAccount(dram_t *dram, const dram_req_t &r) {
+    dram->outcomes[r.outcome] += 1;
+    if (r.core < 0) return;
+
+    long latency = r.done - r.issued;
+    dram->read_cycles += latency;
+    if (latency > dram->max_read) dram->max_read = latency;
+}
+
+// Start the requests of a bank that are served by cycle now
+static inline void dramSettle(dram_t *dram, dram_bank_t *bank, long now) {
+    while (!bank->queued.empty() && bank->queued.front().start <= now) {
+        const dram_req_t &r = bank->queued.front();
+        bank->open_row = dram->page == PageOpen ? r.row : DRAM_NO_ROW;
+        bank->free_at = r.free;
+        dramAccount(dram, r);
+        bank->queued.pop_front();
+    }
+}
+
+// Time the request at position k of a bank after the ones before it
+static inline void dramTime(const dram_t *dram, dram_bank_t *bank, size_t k) {
+    dram_req_t &r = bank->queued[k];
+    long open = k == 0 ? bank->open_row : (dram->page == PageOpen ? bank->queued[k - 1].row : DRAM_NO_ROW);
+    long ready = k == 0 ? bank->free_at : bank->queued[k - 1].free;
+
+    long command;   // Cycles before the column access
+    if (open == r.row) {
+        r.outcome = RowHit;
+        command = 0;
+    }
+    else if (open == DRAM_NO_ROW) {
+        r.outcome = RowEmpty;
+        command = dram->t_rcd;
+    }
+    else {
+        r.outcome = RowConflict;
+        command = dram->t_rp + dram->t_rcd;
+    }
+
+    r.start = max(r.arrival, ready);
+    r.done = r.start + command + dram->t_cas + dram->t_burst;
+    // Column accesses to an open row pipeline behind each other
+    r.free = r.start + command + dram->t_burst;
+    if (dram->page == PageClosed) r.free = r.done + dram->t_rp;
+}
+
+// Issue a read (core >= 0) or a writeback (core = -1) of line at cycle now,
+// returns the cycles until the line has been transferred. Reads it pushed
+// back are listed in dram->pushed for the caller to charge.
+inline long dramRequest(dram_t *dram, int core, uint64_t line, long now) {
+    dram->pushed.clear();
+
+    uint64_t row_index = line / dram->lines_per_row;
+    int channel = (int)(row_index % dram->channels);
+    int bank_index = (int)(row_index / dram->channels % dram->banks);
+    long row = (long)(row_index / dram->channels / dram->banks);
+
+    dram_bank_t *banks = &dram->bank[(size_t)channel * dram->banks];
+    dram_bank_t *bank = &banks[bank_index];
+
+    // Wait for a slot in the channel's queue
+    long arrival = now;
+    vector<long> &starts = dram->starts;
+    starts.clear();
+    for (int b = 0; b < dram->banks; b++) {
+        dramSettle(dram, &banks[b], now);
+        for (const dram_req_t &r : banks[b].queued) starts.push_back(r.start);
+    }
+    if ((long)starts.size() >= dram->queue) {
+        size_t n = starts.size() - dram->queue;
+        nth_element(starts.begin(), starts.begin() + n, starts.end());
+        arrival = starts[n];
+        dram->queue_full += 1;
+        dramSettle(dram, bank, arrival);
+    }
+
+    // FR-FCFS: a row hit goes ahead of the requests to other rows
+    deque<dram_req_t> &queued = bank->queued;
+    size_t k = queued.size();
+    if (dram->page == PageOpen) {
+        size_t hit = queued.size() + 1;
+        if (bank->open_row == row) hit = 0;
+        for (size_t j = 0; j < queued.size(); j++) {
+            if (queued[j].row == row) hit = j + 1;
+        }
+        if (hit < queued.size()) {
+            k = hit;
+            for (size_t j = hit; j < queued.size(); j++) {
+                if (queued[j].bypassed >= DRAM_BYPASS_CAP) k = queued.size();
+            }
+        }
+    }
+
+    dram_req_t req = {core, arrival, now, row, 0, 0, 0, RowHit, 0};
+    queued.insert(queued.begin() + k, req);
+    dramTime(dram, bank, k);
+
+    // Requests behind it start later
+    for (size_t j = k + 1; j < queued.size(); j++) {
+        dram_req_t &r = queued[j];
+        long done = r.done;
+        r.bypassed += 1;
+        dramTime(dram, bank, j);
+        if (r.core >= 0 && r.done > done) {
+            dram_push_t push = {r.core, r.done - done};
+            dram->pushed.push_back(push);
+        }
+    }
+
+    if (core < 0) {
+        dram->writes += 1;
+        return 0;
+    }
+    dram->reads += 1;
+    return queued[k].done - now;
+}
+
+// Start every queued request (end of the run)
+inline void dramDrain(dram_t *dram) {
+    for (dram_bank_t &bank : dram->bank) dramSettle(dram, &bank, LONG_MAX);
+}
+
+inline void dramPrintStats(const dram_t *dram) {
+    long requests = dram->reads + dram->writes;
+    printf("DRAM Reads: %ld\n", dram->reads);
+    printf("DRAM Writes: %ld\n", dram->writes);
+    printf("Row Buffer Hits: %ld (%.2f%%)\n", dram->outcomes[RowHit],
+           requests ? 100.0 * dram->outcomes[RowHit] / requests : 0.0);
+    printf("Row Buffer Empties: %ld\n", dram->outcomes[RowEmpty]);
+    printf("Row Buffer Conflicts: %ld\n", dram->outcomes[RowConflict]);
+    printf("DRAM Read Latency: %.2f cycles (max %ld)\n",
+           dram->reads ? (double)dram->read_cycles / dram->reads : 0.0, dram->max_read);
+    printf("DRAM Queue Full: %ld\n\n", dram->queue_full);
+}
+
+#endif
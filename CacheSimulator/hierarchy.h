@@ -0,0 +1,138 @@
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+using namespace std;
+
+// Lower cache levels (private L2, shared LLC)
+//
+// These levels hold data only; coherence state is tracked in the L1s. Each
+// level stores full line addresses (address >> block bits) so lines can be
+// moved between levels without re-decoding. Lines are never 0xff..ff, so
+// LEVEL_EMPTY marks a free way.
+#define LEVEL_EMPTY (~(uint64_t)0)
+
+// Inclusion policy between a level and the levels above it
+typedef enum
+{
+    Inclusive,  // Lower level holds a superset; its evictions back-invalidate
+    Exclusive,  // A line lives in one level; lower levels are victim caches
+    NINE        // Non-inclusive non-exclusive: filled on miss, no back-invalidation
+} inclusion_t;
+
+typedef struct {
+    long sets;
+    int  assoc;
+    unsigned long set_mask;
+    vector<uint64_t> line;   // Line address per way, LEVEL_EMPTY if free
+    vector<long> lru;        // Last use stamp per way
+    vector<uint8_t> dirty;   // Dirty bit per way
+    long stamp;              // LRU clock
+    long hits;
+    long misses;
+    long evictions;
+    long writebacks;         // Dirty victims passed down
+} cache_level_t;
+
+inline void levelInit(cache_level_t *level, long size, int assoc, int linesize) {
+    level->assoc = assoc;
+    level->sets = size / assoc / linesize;
+    level->set_mask = level->sets - 1;
+    level->line.assign(level->sets * assoc, LEVEL_EMPTY);
+    level->lru.assign(level->sets * assoc, 0);
+    level->dirty.assign(level->sets * assoc, 0);
+    level->stamp = 0;
+    level->hits = 0;
+    level->misses = 0;
+    level->evictions = 0;
+    level->writebacks = 0;
+}
+
+// Index of the way holding line, -1 if absent
+static inline long levelFind(const cache_level_t *level, uint64_t line) {
+    long base = (line & level->set_mask) * level->assoc;
+    for (int i = 0; i < level->assoc; i++) {
+        if (level->line[base + i] == line) return base + i;
+    }
+    return -1;
+}
+
+// Look line up, updating LRU and hit/miss counts
+// Returns 1 on a hit
+inline int levelAccess(cache_level_t *level, uint64_t line) {
+    long way = levelFind(level, line);
+    if (way == -1) {
+        level->misses += 1;
+        return 0;
+    }
+    level->lru[way] = ++level->stamp;
+    level->hits += 1;
+    return 1;
+}
+
+// Insert line (or refresh it if present)
+// Returns 1 and fills *victim / *victim_dirty if a valid line was evicted
+inline int levelInsert(cache_level_t *level, uint64_t line, int dirty,
+                       uint64_t *victim, int *victim_dirty) {
+    long way = levelFind(level, line);
+    if (way != -1) {
+        level->lru[way] = ++level->stamp;
+        level->dirty[way] |= dirty;
+        return 0;
+    }
+
+    // Free way, else LRU way
+    long base = (line & level->set_mask) * level->assoc;
+    way = base;
+    for (int i = 0; i < level->assoc; i++) {
+        if (level->line[base + i] == LEVEL_EMPTY) {
+            way = base + i;
+            break;
+        }
+        if (level->lru[base + i] < level->lru[way]) way = base + i;
+    }
+
+    int evicted = level->line[way] != LEVEL_EMPTY;
+    if (evicted) {
+        *victim = level->line[way];
+        *victim_dirty = level->dirty[way];
+        level->evictions += 1;
+        level->writebacks += level->dirty[way];
+    }
+
+    level->line[way] = line;
+    level->lru[way] = ++level->stamp;
+    level->dirty[way] = dirty;
+    return evicted;
+}
+
+// Mark a resident line dirty, returns 0 if it is not present
+inline int levelMarkDirty(cache_level_t *level, uint64_t line) {
+    long way = levelFind(level, line);
+    if (way == -1) return 0;
+    level->dirty[way] = 1;
+    return 1;
+}
+
+// Drop line; returns 1 if it was present and sets *was_dirty
+inline int levelInvalidate(cache_level_t *level, uint64_t line, int *was_dirty) {
+    long way = levelFind(level, line);
+    if (way == -1) return 0;
+    *was_dirty = level->dirty[way];
+    level->line[way] = LEVEL_EMPTY;
+    level->dirty[way] = 0;
+    return 1;
+}
+
+inline void levelPrintStats(const char *name, const cache_level_t *level) {
+    long accesses = level->hits + level->misses;
+    printf("%s Hits: %ld\n", name, level->hits);
+    printf("%s Misses: %ld\n", name, level->misses);
+    printf("%s Hit Rate: %.2f%%\n", name, accesses ? 100.0 * level->hits / accesses : 0.0);
+    printf("%s Evictions: %ld\n", name, level->evictions);
+    printf("%s Writebacks: %ld\n", name, level->writebacks);
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Support for the parallel simulation engines
+//
+// Simulated cores run in epochs of a bounded number of rounds, each on a
+// worker thread. A core only touches its own caches during an epoch; bus
+// transactions it would broadcast are appended to its own outbox instead.
+// Outboxes have a single writer and are only read by other threads after
+// the end-of-epoch barrier, so no locks are taken on the access path.
+
+// Position of an access in the sequential engine's global order
+// (round, core, read / write slot); used to merge outboxes and logs
+static inline long accessPosition(long round, int core, int num_cores) {
+    return (round * num_cores + core) * 2;
+}
+
+// Bus transaction posted during an epoch
+typedef struct {
+    long pos;          // Position of the access that issued it
+    long addr;         // Address accessed
+    int  core;         // Requesting core
+    int  op;           // bus_op_t
+} bus_msg_t;
+
+// L1 activity logged during a speculative epoch (deterministic engine)
+typedef enum
+{
+    EventRead,         // Read hit
+    EventWrite,        // Write hit (state becomes Modified)
+    EventFill,         // Line filled, state recorded
+    EventEvict         // Line removed (victim or back-invalidation)
+} spec_event_kind_t;
+
+typedef struct {
+    long     pos;
+    uint64_t line;
+    uint8_t  kind;     // spec_event_kind_t
+    uint8_t  state;    // State after a fill, dirtiness of an eviction
+} spec_event_t;
+
+// Reusable barrier for the coordinator and its workers
+typedef struct {
+    mutex lock;
+    condition_variable cv;
+    int threads;
+    int waiting;
+    long generation;
+} epoch_barrier_t;
+
+inline void barrierInit(epoch_barrier_t *b, int threads) {
+    b->threads = threads;
+    b->waiting = 0;
+    b->generation = 0;
+}
+
+inline void barrierWait(epoch_barrier_t *b) {
+    unique_lock<mutex> guard(b->lock);
+    long generation = b->generation;
+
+    if (++b->waiting == b->threads) {
+        b->waiting = 0;
+        b->generation += 1;
+        b->cv.notify_all();
+        return;
+    }
+    b->cv.wait(guard, [&] { return b->generation != generation; });
+}
+
+// Number of worker threads for a requested count (0 = one per host CPU),
+// never more than there are simulated cores
+inline int workerCount(int requested, int num_cores) {
+    int threads = requested > 0 ? requested : (int)thread::hardware_concurrency();
+    if (threads <= 0) threads = 1;
+    return threads < num_cores ? threads : num_cores;
+}
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Hardware prefetchers of the L1 and L2
+//
+// A prefetcher is trained on the demand misses of its level and on the
+// first use of the lines it brought in, and proposes up to `degree` lines:
+//
+//   next-line  the lines following the trigger
+//   stride     a table indexed by the accessing instruction remembers its
+//              last line and stride; once the same stride is seen twice,
+//              the next strides ahead are fetched
+//   stream     trackers follow misses moving through nearby lines in one
+//              direction; once a stream is confirmed, the lines ahead of it
+//              are fetched
+//
+// The stride table is indexed by the instruction address the trace records
+// with each access (version 5 traces); without them it is disabled.
+//
+// Prefetched lines are tracked until their first demand use. A use is
+// useful, and late if the line had not arrived yet (the core waits for the
+// rest). Lines evicted or invalidated before use were useless; the cache
+// drops them from the tracking as they leave, so it only holds lines still
+// in the cache.
+
+typedef enum
+{
+    PrefetchNone,
+    PrefetchNextLine,
+    PrefetchStride,
+    PrefetchStream
+} prefetcher_kind_t;
+
+#define PREFETCH_CONFIDENT 2    // Stride seen this many times in a row
+#define PREFETCH_WINDOW    8    // Lines between two misses of one stream
+
+typedef struct {
+    uint64_t ip;            // Instruction of the entry
+    int64_t  last;          // Latest line
+    int64_t  stride;        // In lines
+    int      confidence;
+} stride_entry_t;
+
+typedef struct {
+    int64_t last;           // Latest line of the stream
+    int     direction;      // +1 / -1, 0 until a second miss
+    int     confirmed;      // Misses that followed the direction
+    long    stamp;          // Latest use, for replacement
+} stream_entry_t;
+
+typedef struct {
+    prefetcher_kind_t kind;
+    int  degree;
+    vector<stride_entry_t> stride;
+    vector<stream_entry_t> streams;
+    long stamp;
+    unordered_map<uint64_t, long> pending;  // Prefetched line -> cycle it arrives
+    vector<int64_t> out;                    // Filled by prefetchTrain
+
+    long issued;            // Lines prefetched
+    long useful;            // Prefetched lines used by a demand access
+    long useless;           // Evicted or invalidated before use
+    long late;              // Used before they arrived
+    long late_cycles;       // Cycles waited for late prefetches
+    long misses;            // Demand misses left
+} prefetcher_t;
+
+inline void prefetchInit(prefetcher_t *pf, prefetcher_kind_t kind, int degree, int entries) {
+    pf->kind = kind;
+    pf->degree = degree;
+    stride_entry_t empty_stride = {0, 0, 0, 0};
+    stream_entry_t empty_stream = {0, 0, 0, -1};
+    pf->stride.assign(kind == PrefetchStride ? entries : 0, empty_stride);
+    pf->streams.assign(kind == PrefetchStream ? entries : 0, empty_stream);
+    pf->stamp = 0;
+    pf->pending.clear();
+    pf->out.clear();
+    pf->issued = 0;
+    pf->useful = 0;
+    pf->useless = 0;
+    pf->late = 0;
+    pf->late_cycles = 0;
+    pf->misses = 0;
+}
+
+// Account a demand access to line at cycle now, returns whether it was the
+// first use of a prefetched line and sets *stall to the cycles still to
+// wait for it. A miss on a prefetched line means it was lost before use.
+inline int prefetchUse(prefetcher_t *pf, uint64_t line, int hit, long now, long *stall) {
+    *stall = 0;
+    if (!hit) pf->misses += 1;
+    if (pf->pending.empty()) return 0;
+
+    auto it = pf->pending.find(line);
+    if (it == pf->pending.end()) return 0;
+
+    if (hit) {
+        pf->useful += 1;
+        if (it->second > now) {
+            *stall = it->second - now;
+            pf->late += 1;
+            pf->late_cycles += *stall;
+        }
+    }
+    else {
+        pf->useless += 1;
+    }
+    pf->pending.erase(it);
+    return hit;
+}
+
+// A line left the cache, returns whether it was an unused prefetch
+inline int prefetchDrop(prefetcher_t *pf, uint64_t line) {
+    if (pf->pending.erase(line) == 0) return 0;
+    pf->useless += 1;
+    return 1;
+}
+
+// Record a line the prefetcher brought in, available at cycle ready
+inline void prefetchIssued(prefetcher_t *pf, uint64_t line, long ready) {
+    pf->pending[line] = ready;
+    pf->issued += 1;
+}
+
+// Train on an access to line by the instruction at ip, leaves the lines to
+// prefetch in pf->out
+inline void prefetchTrain(prefetcher_t *pf, uint64_t line, uint64_t ip) {
+    pf->out.clear();
+    int64_t l = (int64_t)line;
+    int64_t step = 0;
+
+    if (pf->kind == PrefetchNextLine) {
+        step = 1;
+    }
+    else if (pf->kind == PrefetchStride) {
+        stride_entry_t &e = pf->stride[ip % pf->stride.size()];
+        if (e.ip != ip) {
+            e.ip = ip;
+            e.stride = 0;
+            e.confidence = 0;
+        }
+        else if (l - e.last == e.stride && e.stride != 0) {
+            if (e.confidence < PREFETCH_CONFIDENT) e.confidence += 1;
+        }
+        else {
+            e.stride = l - e.last;
+            e.confidence = 0;
+        }
+        e.last = l;
+        if (e.confidence >= PREFETCH_CONFIDENT) step = e.stride;
+    }
+    else if (pf->kind == PrefetchStream) {
+        pf->stamp += 1;
+        stream_entry_t *match = NULL;
+        stream_entry_t *oldest = &pf->streams[0];
+        for (stream_entry_t &s : pf->streams) {
+            int64_t d = l - s.last;
+            if (s.stamp >= 0 && d != 0 && d >= -PREFETCH_WINDOW && d <= PREFETCH_WINDOW &&
+                (s.direction == 0 || (d > 0) == (s.direction > 0))) {
+                match = &s;
+                break;
+            }
+            if (s.stamp < oldest->stamp) oldest = &s;
+        }
+        if (match == NULL) {
+            oldest->last = l;
+            oldest->direction = 0;
+            oldest->confirmed = 0;
+            oldest->stamp = pf->stamp;
+            return;
+        }
+        match->direction = l > match->last ? 1 : -1;
+        match->confirmed += 1;
+        match->last = l;
+        match->stamp = pf->stamp;
+        if (match->confirmed >= PREFETCH_CONFIDENT) step = match->direction;
+    }
+
+    for (int i = 1; step != 0 && i <= pf->degree; i++) {
+        int64_t target = l + step * i;
+        if (target >= 0) pf->out.push_back(target);
+    }
+}
+
+inline void prefetchPrintStats(const char *name, const vector<prefetcher_t> &pfs) {
+    long issued = 0, useful = 0, useless = 0, late = 0, late_cycles = 0, misses = 0;
+    for (const prefetcher_t &pf : pfs) {
+        issued += pf.issued;
+        useful += pf.useful;
+        useless += pf.useless;
+        late += pf.late;
+        late_cycles += pf.late_cycles;
+        misses += pf.misses;
+    }
+    printf("%s Prefetches: %ld\n", name, issued);
+    printf("%s Prefetch Accuracy: %.2f%% (%ld used)\n", name, issued ? 100.0 * useful / issued : 0.0, useful);
+    printf("%s Prefetch Useless: %ld (evicted or invalidated before use)\n", name, useless);
+    printf("%s Prefetch Coverage: %.2f%%\n", name, useful + misses ? 100.0 * useful / (useful + misses) : 0.0);
+    printf("%s Prefetch Timeliness: %.2f%% on time (%ld late, %ld cycles waited)\n", name,
+           useful ? 100.0 * (useful - late) / useful : 0.0, late, late_cycles);
+}
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Per-task cache line profile
+//
+// Built online from a task's accesses (by the Pin tool, or by tracecvt -p
+// from a trace), it keeps what the schedulers use instead of the raw
+// addresses:
+//
+//   footprint     distinct cache lines touched, as runs of consecutive lines
+//   reuse         histogram of reuse distances: the number of distinct other
+//                 lines touched between two accesses to the same line.
+//                 Bucket 0 counts distance 0, bucket k distances in
+//                 [2^(k-1), 2^k). First touches are the footprint itself.
+//   working set   most distinct lines touched within any of the consecutive
+//                 windows of `window` accesses
+//
+// Reuse distances are exact: a Fenwick tree over access times marks the
+// latest access of every line, so a distance is the number of marks since
+// the line's previous access. Times are renumbered when the tree fills up,
+// which keeps it at most a few times the footprint.
+//
+// A profile file holds one text line per task, readable by ast.literal_eval:
+//
+//   # profile line_size <bytes> window <accesses>
+//   (tid, instr_count, accesses, footprint, working_set, [reuse...], [(first line address, lines), ...])
+
+#define PROFILE_BUCKETS 40
+
+typedef struct {
+    uint64_t time;              // Time of the latest access
+    uint64_t window;            // Last window the line was counted in
+} profile_line_t;
+
+typedef struct {
+    int      line_shift;
+    uint64_t window;            // Accesses per working set window
+    uint64_t accesses;          // Line accesses (two for one straddling a line)
+    uint64_t now;               // Current time, 1-based
+    uint64_t window_id;
+    uint64_t window_lines;      // Distinct lines in the current window
+    uint64_t working_set;       // Peak of window_lines
+    uint64_t reuse[PROFILE_BUCKETS];
+    unordered_map<int64_t, profile_line_t> lines;
+    vector<uint32_t> tree;      // Fenwick tree over times 1 .. tree.size() - 1
+} task_profile_t;
+
+inline void profileInit(task_profile_t *p, int line_size, uint64_t window) {
+    p->line_shift = 0;
+    while ((1 << p->line_shift) < line_size) p->line_shift++;
+    p->window = window > 0 ? window : 1;
+    p->accesses = 0;
+    p->now = 0;
+    p->window_id = 0;
+    p->window_lines = 0;
+    p->working_set = 0;
+    memset(p->reuse, 0, sizeof(p->reuse));
+    p->lines.clear();
+    p->tree.assign(1 << 12, 0);
+}
+
+static inline void profileMark(task_profile_t *p, uint64_t time, int delta) {
+    for (uint64_t i = time; i < p->tree.size(); i += i & -i) p->tree[i] += delta;
+}
+
+// Marks at times 1 .. time
+static inline uint64_t profileCount(const task_profile_t *p, uint64_t time) {
+    uint64_t sum = 0;
+    for (uint64_t i = time; i > 0; i -= i & -i) sum += p->tree[i];
+    return sum;
+}
+
+// Renumber the latest access times 1 .. lines, in order, and rebuild the
+// tree with room for as many accesses again
+static inline void profileCompact(task_profile_t *p) {
+    vector<pair<uint64_t, profile_line_t *>> order;
+    order.reserve(p->lines.size());
+    for (auto &it : p->lines) order.push_back(make_pair(it.second.time, &it.second));
+    sort(order.begin(), order.end());
+
+    size_t size = p->tree.size();
+    while (size < 2 * order.size() + 2) size *= 2;
+    p->tree.assign(size, 0);
+
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i].second->time = i + 1;
+        profileMark(p, i + 1, 1);
+    }
+    p->now = order.size();
+}
+
+static inline void profileLine(task_profile_t *p, int64_t line) {
+    if (p->now + 1 >= p->tree.size()) profileCompact(p);
+    p->now += 1;
+
+    uint64_t window_id = p->accesses / p->window;
+    if (window_id != p->window_id) {
+        p->window_id = window_id;
+        p->window_lines = 0;
+    }
+    p->accesses += 1;
+
+    auto ins = p->lines.insert(make_pair(line, profile_line_t()));
+    profile_line_t *l = &ins.first->second;
+
+    if (ins.second) {
+        l->window = window_id;
+        p->window_lines += 1;
+    }
+    else {
+        uint64_t distance = profileCount(p, p->now - 1) - profileCount(p, l->time);
+        int bucket = 0;
+        while (distance >> bucket) bucket++;
+        p->reuse[bucket < PROFILE_BUCKETS ? bucket : PROFILE_BUCKETS - 1] += 1;
+        profileMark(p, l->time, -1);
+
+        if (l->window != window_id) {
+            l->window = window_id;
+            p->window_lines += 1;
+        }
+    }
+
+    l->time = p->now;
+    profileMark(p, p->now, 1);
+    if (p->window_lines > p->working_set) p->working_set = p->window_lines;
+}
+
+// Add one access of size bytes (at least 1) at addr
+inline void profileAccess(task_profile_t *p, int64_t addr, uint32_t size) {
+    int64_t first = addr >> p->line_shift;
+    int64_t last = (addr + (size > 0 ? size : 1) - 1) >> p->line_shift;
+    for (int64_t line = first; line <= last; line++) {
+        profileLine(p, line);
+    }
+}
+
+inline void profileWriteHeader(FILE *out, int line_size, uint64_t window) {
+    fprintf(out, "# profile line_size %d window %lu\n", line_size, (unsigned long)window);
+}
+
+// Write the profile of one task
+inline void profileWrite(FILE *out, long thread_id, long instr_count, const task_profile_t *p) {
+    fprintf(out, "(%ld, %ld, %lu, %lu, %lu, [", thread_id, instr_count, (unsigned long)p->accesses,
+            (unsigned long)p->lines.size(), (unsigned long)p->working_set);
+
+    int buckets = PROFILE_BUCKETS;
+    while (buckets > 0 && p->reuse[buckets - 1] == 0) buckets--;
+    for (int i = 0; i < buckets; i++) {
+        fprintf(out, i == 0 ? "%lu" : ", %lu", (unsigned long)p->reuse[i]);
+    }
+    fprintf(out, "], [");
+
+    // Footprint as runs of consecutive lines
+    vector<int64_t> lines;
+    lines.reserve(p->lines.size());
+    for (const auto &it : p->lines) lines.push_back(it.first);
+    sort(lines.begin(), lines.end());
+
+    for (size_t i = 0; i < lines.size();) {
+        size_t j = i + 1;
+        while (j < lines.size() && lines[j] == lines[j - 1] + 1) j++;
+        fprintf(out, "%s(%ld, %lu)", i == 0 ? "" : ", ",
+                (long)(lines[i] << p->line_shift), (unsigned long)(j - i));
+        i = j;
+    }
+    fprintf(out, "])\n");
+}
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+#include <stdint.h>
+
+// L1 replacement policies
+//
+// Chosen with `replacement` in the configuration and compiled into the
+// simulator as a template parameter, like the L1 geometry. Each policy keeps
+// `words` 64-bit words of state per set (next to the LRU stamps) and
+// implements
+//
+//   hit(set, way, count)         the way was accessed
+//   fill(set, way, count, rng)   the way received a new line
+//   victim(set, count, rng)      way to evict from a full set
+//
+// Only LRU scans: its stamps cost one store per hit, and the scan over the
+// ways only runs on misses. The other policies find the victim with a few
+// bit operations.
+
+typedef enum
+{
+    ReplaceLRU,     // True LRU (timestamps)
+    ReplacePLRU,    // Tree pseudo-LRU
+    ReplaceSRRIP,   // Static re-reference interval prediction (2-bit)
+    ReplaceBRRIP,   // Bimodal RRIP: mostly distant insertion
+    ReplaceRandom
+} replacement_t;
+
+// Replacement state of one set
+typedef struct {
+    long     *stamp;    // Per way, latest access (LRU)
+    uint64_t *bits;     // Policy words of the set
+    int       assoc;
+} repl_set_t;
+
+static inline uint64_t replRandom(uint64_t *rng) {
+    // xorshift64
+    uint64_t x = *rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *rng = x;
+    return x;
+}
+
+struct LRUPolicy {
+    static constexpr int words = 0;
+
+    static void hit(repl_set_t set, int way, long count) {
+        set.stamp[way] = count;
+    }
+    static void fill(repl_set_t set, int way, long count, uint64_t * /*rng*/) {
+        set.stamp[way] = count;
+    }
+    static int victim(repl_set_t set, long count, uint64_t * /*rng*/) {
+        int oldest_way = 0;
+        long oldest_count = count;
+        for (int i = 0; i < set.assoc; i++) {
+            if (set.stamp[i] < oldest_count) {
+                oldest_way = i;
+                oldest_count = set.stamp[i];
+            }
+        }
+        return oldest_way;
+    }
+};
+
+// Binary tree over the ways (assoc must be a power of two). Node n (heap
+// order, root 1) is bit n of the set's word, set when the next victim is
+// in its right half.
+struct TreePLRUPolicy {
+    static constexpr int words = 1;
+
+    static void touch(repl_set_t set, int way) {
+        uint64_t bits = set.bits[0];
+        int node = 1;
+        for (int half = set.assoc >> 1; half > 0; half >>= 1) {
+            int right = (way & half) != 0;
+            // Point away from the accessed way
+            if (right) bits &= ~((uint64_t)1 << node);
+            else bits |= (uint64_t)1 << node;
+            node = 2 * node + right;
+        }
+        set.bits[0] = bits;
+    }
+    static void hit(repl_set_t set, int way, long /*count*/) {
+        touch(set, way);
+    }
+    static void fill(repl_set_t set, int way, long /*count*/, uint64_t * /*rng*/) {
+        touch(set, way);
+    }
+    static int victim(repl_set_t set, long /*count*/, uint64_t * /*rng*/) {
+        uint64_t bits = set.bits[0];
+        int node = 1;
+        while (node < set.assoc) {
+            node = 2 * node + (int)((bits >> node) & 1);
+        }
+        return node - set.assoc;
+    }
+};
+
+// RRIP with 2-bit re-reference predictions, kept as one way mask per value
+// so that aging the whole set is a shift of the masks
+template <int BIMODAL>
+struct RRIPPolicy {
+    static constexpr int words = 4;
+
+    static void place(repl_set_t set, int way, int rrpv) {
+        uint64_t bit = (uint64_t)1 << way;
+        for (int v = 0; v < 4; v++) set.bits[v] &= ~bit;
+        set.bits[rrpv] |= bit;
+    }
+    static void hit(repl_set_t set, int way, long /*count*/) {
+        place(set, way, 0);
+    }
+    static void fill(repl_set_t set, int way, long /*count*/, uint64_t *rng) {
+        // BRRIP inserts at distant (3) except for one fill in 32
+        if (BIMODAL) {
+            *rng += 1;
+            place(set, way, (*rng & 31) == 0 ? 2 : 3);
+        }
+        else {
+            place(set, way, 2);
+        }
+    }
+    static int victim(repl_set_t set, long /*count*/, uint64_t * /*rng*/) {
+        // Every way of a full set has been filled, so some mask is non-empty
+        while (set.bits[3] == 0) {
+            set.bits[3] = set.bits[2];
+            set.bits[2] = set.bits[1];
+            set.bits[1] = set.bits[0];
+            set.bits[0] = 0;
+        }
+        return __builtin_ctzll(set.bits[3]);
+    }
+};
+
+typedef RRIPPolicy<0> SRRIPPolicy;
+typedef RRIPPolicy<1> BRRIPPolicy;
+
+struct RandomPolicy {
+    static constexpr int words = 0;
+
+    static void hit(repl_set_t /*set*/, int /*way*/, long /*count*/) {
+    }
+    static void fill(repl_set_t /*set*/, int /*way*/, long /*count*/, uint64_t * /*rng*/) {
+    }
+    static int victim(repl_set_t set, long /*count*/, uint64_t *rng) {
+        return (int)((replRandom(rng) >> 32) % set.assoc);
+    }
+};
+
+#endif
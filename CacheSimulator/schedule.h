@@ -0,0 +1,195 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdio.h>
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Task to core assignments
+//
+// A schedule file holds one or more schedule dicts as printed by the
+// schedulers' get_schedule() (str(), repr() of a defaultdict, or JSON):
+//
+//   dmda: {0: [6, 2], 1: [7, 13, 19, 1]}
+//   hfp:  defaultdict(<class 'list'>, {0: [...], 1: [...]})
+//
+// Each dict maps a core to the tasks it runs, in order. An optional name
+// before the dict labels it in the results; otherwise schedules are
+// numbered from 1. Lines starting with # are comments. Core ids must be
+// below SCHEDULE_MAX_CORES (the configured num_cores is checked later).
+#define SCHEDULE_MAX_CORES 4096
+
+typedef struct {
+    string name;
+    vector<vector<int>> cores;   // Tasks of each core, in run order
+} schedule_t;
+
+// Built-in schedule of the matmul trace (7 cores)
+inline schedule_t defaultSchedule() {
+    schedule_t schedule;
+    schedule.name = "built-in";
+    schedule.cores = {
+        {6, 2},
+        {7, 13, 19, 1},
+        {11, 17, 23, 28, 33, 38, 43, 4},
+        {5, 12, 18, 24, 29, 34, 39, 44, 3},
+        {10, 16, 22, 27, 32, 37, 42, 47, 50, 53, 56},
+        {9, 15, 21, 26, 31, 36, 41, 46, 49, 52, 55},
+        {8, 14, 20, 25, 30, 35, 40, 45, 48, 51, 54},
+    };
+    return schedule;
+}
+
+// Cores a schedule uses (highest core with tasks + 1)
+inline int scheduleCores(const schedule_t &schedule) {
+    int cores = 0;
+    for (size_t i = 0; i < schedule.cores.size(); i++) {
+        if (!schedule.cores[i].empty()) cores = i + 1;
+    }
+    return cores;
+}
+
+static inline int scheduleSkipSpace(const string &text, size_t *pos) {
+    while (*pos < text.size() && isspace((unsigned char)text[*pos])) (*pos)++;
+    return *pos < text.size() ? text[*pos] : -1;
+}
+
+static inline int scheduleNumber(const string &text, size_t *pos, long *out) {
+    scheduleSkipSpace(text, pos);
+    int quoted = *pos < text.size() && (text[*pos] == '"' || text[*pos] == '\'');
+    if (quoted) (*pos)++;
+
+    const char *begin = text.c_str() + *pos;
+    char *end;
+    *out = strtol(begin, &end, 10);
+    if (end == begin) return -1;
+    *pos += end - begin;
+
+    if (quoted) {
+        if (*pos >= text.size() || (text[*pos] != '"' && text[*pos] != '\'')) return -1;
+        (*pos)++;
+    }
+    return 0;
+}
+
+// Line of text[pos], counting from 1
+static inline int scheduleLine(const string &text, size_t pos) {
+    int line = 1;
+    for (size_t i = 0; i < pos && i < text.size(); i++) line += text[i] == '\n';
+    return line;
+}
+
+// Parse the dict starting at text[*pos] == '{'
+// On failure *pos is left near the offending text.
+static inline int parseScheduleDict(const string &text, size_t *pos, schedule_t *schedule, const char *path) {
+    (*pos)++;
+    if (scheduleSkipSpace(text, pos) == '}') {
+        (*pos)++;
+        return 0;
+    }
+
+    while (1) {
+        long core, task;
+        if (scheduleNumber(text, pos, &core) == -1 || core < 0 ||
+            scheduleSkipSpace(text, pos) != ':') return -1;
+        if (core >= SCHEDULE_MAX_CORES) {
+            printf("%s:%d: core %ld out of range (at most %d cores)\n", path,
+                   scheduleLine(text, *pos), core, SCHEDULE_MAX_CORES);
+            return -1;
+        }
+        (*pos)++;
+        if (scheduleSkipSpace(text, pos) != '[') return -1;
+        (*pos)++;
+
+        if ((long)schedule->cores.size() <= core) schedule->cores.resize(core + 1);
+        vector<int> &tasks = schedule->cores[core];
+
+        if (scheduleSkipSpace(text, pos) == ']') {
+            (*pos)++;
+        }
+        else {
+            while (1) {
+                if (scheduleNumber(text, pos, &task) == -1) return -1;
+                if (task < 0 || task > INT_MAX) {
+                    printf("%s:%d: task %ld out of range\n", path, scheduleLine(text, *pos), task);
+                    return -1;
+                }
+                tasks.push_back(task);
+
+                int c = scheduleSkipSpace(text, pos);
+                (*pos)++;
+                if (c == ']') break;
+                if (c != ',') return -1;
+            }
+        }
+
+        int c = scheduleSkipSpace(text, pos);
+        (*pos)++;
+        if (c == '}') return 0;
+        if (c != ',') return -1;
+    }
+}
+
+// Read every schedule of a schedule file
+inline int readScheduleFile(const char *path, vector<schedule_t> &schedules) {
+    FILE *fptr = fopen(path, "r");
+    if (fptr == NULL) {
+        printf("Error Opening Schedule File!\n");
+        return -1;
+    }
+
+    // Whole file with comment lines blanked (dicts may span lines, and
+    // line numbers stay those of the file)
+    string text;
+    char *line = NULL;
+    size_t len = 0;
+    while (getline(&line, &len, fptr) != -1) {
+        size_t first = 0;
+        while (line[first] == ' ' || line[first] == '\t') first++;
+        text += line[first] != '#' ? line : "\n";
+    }
+    free(line);
+    fclose(fptr);
+
+    size_t pos = 0;
+    size_t label = 0;
+    while (pos < text.size()) {
+        size_t open = text.find('{', pos);
+        if (open == string::npos) break;
+
+        schedule_t schedule;
+
+        // A name ends with ':' before the dict (defaultdict(...) is not a name)
+        size_t line_start = text.rfind('\n', open);
+        line_start = line_start == string::npos || line_start < label ? label : line_start + 1;
+        string prefix = text.substr(line_start, open - line_start);
+        size_t colon = prefix.find(':');
+        if (colon != string::npos) {
+            size_t b = prefix.find_first_not_of(" \t");
+            size_t e = prefix.find_last_not_of(" \t", colon - 1);
+            if (b != string::npos && b < colon) schedule.name = prefix.substr(b, e - b + 1);
+        }
+        if (schedule.name.empty()) schedule.name = to_string(schedules.size() + 1);
+
+        pos = open;
+        if (parseScheduleDict(text, &pos, &schedule, path) == -1) {
+            printf("Malformed schedule %s in %s at line %d\n", schedule.name.c_str(), path,
+                   scheduleLine(text, pos));
+            return -1;
+        }
+        label = pos;
+        schedules.push_back(schedule);
+    }
+
+    if (schedules.empty()) {
+        printf("No schedule found in %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <stdint.h>
+#include <vector>
+using namespace std;
+
+// Shadow caches of one core for miss classification (3C + coherence)
+//
+// Every access of the core is replayed against an infinite cache and a
+// fully-associative LRU cache of the same number of lines. A miss of the
+// real cache is then
+//
+//   cold        if the infinite cache never saw the line
+//   coherence   if the core's copy was invalidated by another core's write
+//               since its last access
+//   capacity    if the fully-associative cache misses as well
+//   conflict    if only the set-associative cache misses
+//
+// Both shadows share one open-addressing hash table keyed by line: entries
+// are never removed (the infinite cache keeps every line), and each one
+// points at its node in the intrusive LRU list of the fully-associative
+// cache, or -1 when the line is not resident there. An access therefore
+// costs one probe plus a few index updates.
+
+typedef enum
+{
+    ShadowCold,
+    ShadowCoherence,
+    ShadowCapacity,
+    ShadowConflict      // Fully-associative hit
+} shadow_class_t;
+
+typedef struct {
+    uint64_t key;           // line + 1, 0 for an empty slot
+    int32_t  node;          // LRU node, -1 if not resident
+    uint8_t  invalidated;   // Lost to another core's write since the last access
+} shadow_entry_t;
+
+typedef struct {
+    vector<shadow_entry_t> table;
+    size_t used;
+
+    // Fully-associative LRU: nodes linked most recent first
+    vector<uint64_t> node_line;
+    vector<int32_t>  prev;
+    vector<int32_t>  next;
+    vector<int32_t>  free_nodes;
+    int32_t head;
+    int32_t tail;
+} shadow_cache_t;
+
+inline void shadowInit(shadow_cache_t *s, long lines) {
+    s->table.assign(1024, shadow_entry_t());
+    s->used = 0;
+    s->node_line.assign(lines, 0);
+    s->prev.assign(lines, -1);
+    s->next.assign(lines, -1);
+    s->free_nodes.resize(lines);
+    for (long i = 0; i < lines; i++) {
+        s->free_nodes[i] = lines - 1 - i;
+    }
+    s->head = -1;
+    s->tail = -1;
+}
+
+static inline size_t shadowSlot(const shadow_cache_t *s, uint64_t line) {
+    size_t mask = s->table.size() - 1;
+    size_t i = (size_t)((line * 0x9E3779B97F4A7C15ull) >> 20) & mask;
+    while (s->table[i].key != 0 && s->table[i].key != line + 1) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+// Double the table once it is half full
+static inline void shadowGrow(shadow_cache_t *s) {
+    vector<shadow_entry_t> old;
+    old.swap(s->table);
+    s->table.assign(old.size() * 2, shadow_entry_t());
+    for (const shadow_entry_t &e : old) {
+        if (e.key != 0) s->table[shadowSlot(s, e.key - 1)] = e;
+    }
+}
+
+static inline void shadowUnlink(shadow_cache_t *s, int32_t node) {
+    if (s->prev[node] != -1) s->next[s->prev[node]] = s->next[node];
+    else s->head = s->next[node];
+    if (s->next[node] != -1) s->prev[s->next[node]] = s->prev[node];
+    else s->tail = s->prev[node];
+}
+
+static inline void shadowPushFront(shadow_cache_t *s, int32_t node) {
+    s->prev[node] = -1;
+    s->next[node] = s->head;
+    if (s->head != -1) s->prev[s->head] = node;
+    else s->tail = node;
+    s->head = node;
+}
+
+// Make line the most recent line of the fully-associative cache
+static inline void shadowInsert(shadow_cache_t *s, shadow_entry_t *e, uint64_t line) {
+    int32_t node;
+    if (!s->free_nodes.empty()) {
+        node = s->free_nodes.back();
+        s->free_nodes.pop_back();
+    }
+    else {
+        // Evict the least recent line
+        node = s->tail;
+        shadowUnlink(s, node);
+        s->table[shadowSlot(s, s->node_line[node])].node = -1;
+    }
+    s->node_line[node] = line;
+    e->node = node;
+    shadowPushFront(s, node);
+}
+
+// Replay an access to line, returning how a miss on it is classified
+static inline shadow_class_t shadowAccess(shadow_cache_t *s, uint64_t line) {
+    size_t i = shadowSlot(s, line);
+    shadow_entry_t *e = &s->table[i];
+
+    if (e->key == 0) {
+        if (2 * (s->used + 1) > s->table.size()) {
+            shadowGrow(s);
+            e = &s->table[shadowSlot(s, line)];
+        }
+        s->used += 1;
+        e->key = line + 1;
+        e->invalidated = 0;
+        shadowInsert(s, e, line);
+        return ShadowCold;
+    }
+
+    if (e->node != -1) {
+        // Fully-associative hit: move to the front
+        if (s->head != e->node) {
+            shadowUnlink(s, e->node);
+            shadowPushFront(s, e->node);
+        }
+        return ShadowConflict;
+    }
+
+    shadowInsert(s, e, line);
+    if (e->invalidated) {
+        e->invalidated = 0;
+        return ShadowCoherence;
+    }
+    return ShadowCapacity;
+}
+
+// Another core's write removed this core's copy of line
+static inline void shadowInvalidate(shadow_cache_t *s, uint64_t line) {
+    shadow_entry_t *e = &s->table[shadowSlot(s, line)];
+    if (e->key == 0) {
+        return;
+    }
+    e->invalidated = 1;
+    if (e->node != -1) {
+        shadowUnlink(s, e->node);
+        s->free_nodes.push_back(e->node);
+        e->node = -1;
+    }
+}
+
+#endif
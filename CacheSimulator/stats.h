@@ -0,0 +1,223 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include "shadow.h"
+using namespace std;
+
+// Detailed L1 statistics (--stats / --timeline / --classify)
+//
+// Counted per task, per core and per L1 set of each core. Misses are
+// classified as cold, capacity, conflict or coherence misses by the shadow
+// caches of each core (see shadow.h), which see every access. With
+// --timeline, one CSV row per core is also written every `interval` of its
+// steps, holding the counts of that interval.
+
+typedef struct {
+    long hits;
+    long cold_misses;
+    long capacity_misses;
+    long conflict_misses;
+    long coherence_misses;
+    long invalidations;      // Copies invalidated by another core's write
+    long flushes;            // Modified copies flushed on a snoop
+    long writebacks;         // Modified copies evicted
+} access_stats_t;
+
+typedef struct {
+    long sets;
+    vector<access_stats_t> cores;
+    vector<access_stats_t> set_stats;                    // core * sets + set
+    vector<shadow_cache_t> shadows;                      // Per core
+    unordered_map<long, access_stats_t> tasks;
+    vector<access_stats_t *> running;                    // Per core, stats of the running task
+
+    // Timeline
+    FILE *timeline;
+    long interval;
+    vector<long> steps;
+    vector<long> running_id;
+    vector<access_stats_t> last;                         // Per core, totals at the previous row
+} sim_stats_t;
+
+inline void statsInit(sim_stats_t *s, int num_cores, long sets, int assoc) {
+    s->sets = sets;
+    s->cores.assign(num_cores, access_stats_t());
+    s->set_stats.assign(num_cores * sets, access_stats_t());
+    s->shadows.resize(num_cores);
+    for (shadow_cache_t &shadow : s->shadows) {
+        shadowInit(&shadow, sets * assoc);
+    }
+    s->tasks.clear();
+    s->running.assign(num_cores, NULL);
+    s->timeline = NULL;
+    s->interval = 0;
+    s->steps.assign(num_cores, 0);
+    s->running_id.assign(num_cores, -1);
+    s->last.assign(num_cores, access_stats_t());
+}
+
+// Attribute the following events of a core to a task
+static inline void statsTask(sim_stats_t *s, int core, long task_id) {
+    if (s->running_id[core] != task_id) {
+        s->running_id[core] = task_id;
+        s->running[core] = &s->tasks[task_id];
+    }
+}
+
+static inline void statsCount(sim_stats_t *s, int core, long set, long access_stats_t::*field) {
+    s->cores[core].*field += 1;
+    s->set_stats[core * s->sets + set].*field += 1;
+    if (s->running[core] != NULL) {
+        s->running[core]->*field += 1;
+    }
+}
+
+static inline void statsHit(sim_stats_t *s, int core, long set, uint64_t line) {
+    shadowAccess(&s->shadows[core], line);
+    statsCount(s, core, set, &access_stats_t::hits);
+}
+
+// Classify a miss of core on line
+static inline void statsMiss(sim_stats_t *s, int core, long set, uint64_t line) {
+    static long access_stats_t::*const fields[] = {
+        &access_stats_t::cold_misses,       // ShadowCold
+        &access_stats_t::coherence_misses,  // ShadowCoherence
+        &access_stats_t::capacity_misses,   // ShadowCapacity
+        &access_stats_t::conflict_misses    // ShadowConflict
+    };
+    statsCount(s, core, set, fields[shadowAccess(&s->shadows[core], line)]);
+}
+
+// Another core's write removed core's copy of line
+static inline void statsInvalidate(sim_stats_t *s, int core, long set, uint64_t line) {
+    statsCount(s, core, set, &access_stats_t::invalidations);
+    shadowInvalidate(&s->shadows[core], line);
+}
+
+static inline void statsFlush(sim_stats_t *s, int core, long set) {
+    statsCount(s, core, set, &access_stats_t::flushes);
+}
+
+static inline void statsWriteback(sim_stats_t *s, int core, long set) {
+    statsCount(s, core, set, &access_stats_t::writebacks);
+}
+
+static inline void writeStatsCSVRow(FILE *out, const access_stats_t *a) {
+    fprintf(out, "%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld\n", a->hits, a->cold_misses, a->capacity_misses,
+            a->conflict_misses, a->coherence_misses, a->invalidations, a->flushes, a->writebacks);
+}
+
+#define STATS_CSV_FIELDS "hits,cold_misses,capacity_misses,conflict_misses,coherence_misses," \
+                         "invalidations,flushes,writebacks"
+
+// One step of a core done at cycle, writes a timeline row every interval
+static inline void statsStep(sim_stats_t *s, int core, long cycle) {
+    if (s->timeline == NULL || ++s->steps[core] % s->interval != 0) {
+        return;
+    }
+
+    access_stats_t delta = s->cores[core];
+    const access_stats_t &last = s->last[core];
+    delta.hits -= last.hits;
+    delta.cold_misses -= last.cold_misses;
+    delta.capacity_misses -= last.capacity_misses;
+    delta.conflict_misses -= last.conflict_misses;
+    delta.coherence_misses -= last.coherence_misses;
+    delta.invalidations -= last.invalidations;
+    delta.flushes -= last.flushes;
+    delta.writebacks -= last.writebacks;
+    s->last[core] = s->cores[core];
+
+    fprintf(s->timeline, "%d,%ld,%ld,%ld,", core, s->running_id[core], s->steps[core], cycle);
+    writeStatsCSVRow(s->timeline, &delta);
+}
+
+inline void statsStartTimeline(sim_stats_t *s, FILE *timeline, long interval) {
+    s->timeline = timeline;
+    s->interval = interval;
+    fprintf(timeline, "core,task,step,cycle," STATS_CSV_FIELDS "\n");
+}
+
+static inline void writeStatsJSONObject(FILE *out, const access_stats_t *a) {
+    fprintf(out, "\"hits\": %ld, \"cold_misses\": %ld, \"capacity_misses\": %ld, \"conflict_misses\": %ld, "
+                 "\"coherence_misses\": %ld, \"invalidations\": %ld, \"flushes\": %ld, \"writebacks\": %ld}",
+            a->hits, a->cold_misses, a->capacity_misses, a->conflict_misses, a->coherence_misses,
+            a->invalidations, a->flushes, a->writebacks);
+}
+
+static inline vector<long> statsTaskIds(const sim_stats_t *s) {
+    vector<long> ids;
+    for (const auto &it : s->tasks) ids.push_back(it.first);
+    sort(ids.begin(), ids.end());
+    return ids;
+}
+
+// Rows of scope (core, task or set), id, core, set and the counts
+// Sets no access reached are left out.
+inline void writeStatsCSV(FILE *out, const sim_stats_t *s) {
+    fprintf(out, "scope,id,core,set," STATS_CSV_FIELDS "\n");
+    for (size_t core = 0; core < s->cores.size(); core++) {
+        fprintf(out, "core,%zu,%zu,,", core, core);
+        writeStatsCSVRow(out, &s->cores[core]);
+    }
+    for (long id : statsTaskIds(s)) {
+        fprintf(out, "task,%ld,,,", id);
+        writeStatsCSVRow(out, &s->tasks.at(id));
+    }
+    for (size_t core = 0; core < s->cores.size(); core++) {
+        for (long set = 0; set < s->sets; set++) {
+            const access_stats_t *a = &s->set_stats[core * s->sets + set];
+            if (a->hits == 0 && a->cold_misses == 0 && a->invalidations == 0) continue;
+            fprintf(out, "set,%zu,%zu,%ld,", core * s->sets + set, core, set);
+            writeStatsCSVRow(out, a);
+        }
+    }
+}
+
+// {"cores": [...], "tasks": [...], "sets": [[core 0 sets], ...]}
+inline void writeStatsJSON(FILE *out, const sim_stats_t *s) {
+    fprintf(out, "{\n  \"cores\": [\n");
+    for (size_t core = 0; core < s->cores.size(); core++) {
+        fprintf(out, "    {\"core\": %zu, ", core);
+        writeStatsJSONObject(out, &s->cores[core]);
+        fprintf(out, core + 1 < s->cores.size() ? ",\n" : "\n");
+    }
+
+    fprintf(out, "  ],\n  \"tasks\": [\n");
+    vector<long> ids = statsTaskIds(s);
+    for (size_t i = 0; i < ids.size(); i++) {
+        fprintf(out, "    {\"task\": %ld, ", ids[i]);
+        writeStatsJSONObject(out, &s->tasks.at(ids[i]));
+        fprintf(out, i + 1 < ids.size() ? ",\n" : "\n");
+    }
+
+    fprintf(out, "  ],\n  \"sets\": [\n");
+    for (size_t core = 0; core < s->cores.size(); core++) {
+        fprintf(out, "    [\n");
+        for (long set = 0; set < s->sets; set++) {
+            fprintf(out, "      {\"set\": %ld, ", set);
+            writeStatsJSONObject(out, &s->set_stats[core * s->sets + set]);
+            fprintf(out, set + 1 < s->sets ? ",\n" : "\n");
+        }
+        fprintf(out, core + 1 < s->cores.size() ? "    ],\n" : "    ]\n");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// Per core miss breakdown for printStats
+inline void statsPrintCore(const sim_stats_t *s, int core) {
+    const access_stats_t *a = &s->cores[core];
+    printf("Hits: %ld\n", a->hits);
+    printf("Misses: %ld cold, %ld capacity, %ld conflict, %ld coherence\n",
+           a->cold_misses, a->capacity_misses, a->conflict_misses, a->coherence_misses);
+    printf("Invalidations Received: %ld\n", a->invalidations);
+    printf("Modified Flushes: %ld (snoops), %ld (evictions)\n", a->flushes, a->writebacks);
+}
+
+#endif
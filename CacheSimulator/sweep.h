@@ -0,0 +1,210 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "schedule.h"
+using namespace std;
+
+// Parameter sweeps
+//
+// A sweep file uses the config file syntax, except that a value may be a
+// comma separated list. Every combination of the listed values (applied on
+// top of the base configuration) is simulated once against the same loaded
+// trace, and each run becomes one row of a CSV or JSON table.
+//
+//   l1_size  = 16K, 32K, 64K
+//   l1_assoc = 4, 8
+//   l2_size  = 0, 256K
+
+typedef struct {
+    string key;
+    vector<string> values;
+} sweep_param_t;
+
+// Summary of one run of a sweep
+typedef struct {
+    sim_config_t config;
+    const schedule_t *schedule;
+    vector<string> values;     // Value of each swept parameter
+    int    status;             // 0 on success, -1 if the run failed
+    double seconds;            // Wall time of the run
+    long   reads;
+    long   writes;
+    long   evictions;
+    long   bus_responses;
+    long   interconnect_traffic;
+    long   max_cycles;         // Cycle count of the slowest core
+    long   total_cycles;       // Sum of the cores' cycle counts
+    long   l2_hits;
+    long   l2_misses;
+    long   llc_hits;
+    long   llc_misses;
+    long   memory_fetches;
+    long   memory_writebacks;
+    long   c2c_transfers;      // L1 misses supplied by another L1
+    long   bus_wait;           // Cycles the cores queued for the bus
+    long   dram_wait;          // Cycles reads were pushed back by row hits
+    long   dram_row_hits;
+    long   dram_requests;
+    long   remote_fetches;     // Memory fetches from another socket's node
+    long   cross_socket;       // Bus transactions that found the line on another socket
+    long   prefetches;         // Lines prefetched (L1 and L2)
+    long   prefetch_useful;    // Prefetched lines used
+    long   prefetch_misses;    // Demand misses left at the prefetching levels
+} sweep_result_t;
+
+static inline vector<string> splitSweepValues(const string &value) {
+    vector<string> values;
+    size_t begin = 0;
+    while (1) {
+        size_t comma = value.find(',', begin);
+        string item = trimConfig(value.substr(begin, comma == string::npos ? string::npos : comma - begin));
+        if (!item.empty()) values.push_back(item);
+        if (comma == string::npos) break;
+        begin = comma + 1;
+    }
+    return values;
+}
+
+// Read the swept parameters of a sweep file
+inline int readSweepFile(const char *path, vector<sweep_param_t> &params) {
+    FILE *fptr = fopen(path, "r");
+    if (fptr == NULL) {
+        printf("Error Opening Sweep File!\n");
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t len = 0;
+    int ret = 0;
+
+    while (getline(&line, &len, fptr) != -1) {
+        char *comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+
+        string text = trimConfig(line);
+        if (text.empty()) continue;
+
+        size_t eq = text.find('=');
+        sweep_param_t param;
+        if (eq != string::npos) {
+            param.key = trimConfig(text.substr(0, eq));
+            param.values = splitSweepValues(text.substr(eq + 1));
+        }
+        if (param.key.empty() || param.values.empty()) {
+            printf("Expected key = value[, value...], got: %s\n", text.c_str());
+            ret = -1;
+            break;
+        }
+        params.push_back(param);
+    }
+
+    free(line);
+    fclose(fptr);
+    return ret;
+}
+
+// Expand the parameters into one configuration per combination
+// The last parameter varies fastest. Combinations that do not describe a
+// valid cache (e.g. a size not divisible by the associativity) are skipped.
+inline int expandSweep(const sim_config_t &base, const vector<sweep_param_t> &params,
+                       vector<sweep_result_t> &runs) {
+    vector<size_t> index(params.size(), 0);
+
+    while (1) {
+        sweep_result_t run = sweep_result_t();
+        run.config = base;
+
+        for (size_t i = 0; i < params.size(); i++) {
+            const string &value = params[i].values[index[i]];
+            if (setConfigValue(&run.config, params[i].key.c_str(), value.c_str()) == -1) {
+                return -1;
+            }
+            run.values.push_back(value);
+        }
+        if (validateConfig(&run.config) == -1) {
+            printf("  skipping combination:");
+            for (size_t i = 0; i < params.size(); i++) {
+                printf(" %s=%s", params[i].key.c_str(), run.values[i].c_str());
+            }
+            printf("\n");
+        }
+        else {
+            runs.push_back(run);
+        }
+
+        // Next combination
+        size_t i = params.size();
+        while (i > 0 && ++index[i - 1] == params[i - 1].values.size()) {
+            index[i - 1] = 0;
+            i--;
+        }
+        if (i == 0) break;
+    }
+
+    if (runs.empty()) {
+        printf("No valid combinations in the sweep\n");
+        return -1;
+    }
+    return 0;
+}
+
+static inline double hitRate(long hits, long misses) {
+    return hits + misses ? 100.0 * hits / (hits + misses) : 0.0;
+}
+
+// Write the results as CSV, one row per run
+inline void writeSweepCSV(FILE *out, const vector<sweep_param_t> &params,
+                          const vector<sweep_result_t> &runs) {
+    for (const sweep_param_t &param : params) fprintf(out, "%s,", param.key.c_str());
+    fprintf(out, "status,seconds,reads,writes,evictions,bus_responses,interconnect_traffic,"
+                 "max_cycles,total_cycles,l2_hit_rate,llc_hit_rate,memory_fetches,memory_writebacks,"
+                 "c2c_transfers,bus_wait,dram_row_hit_rate,dram_wait,remote_fetches,cross_socket,"
+                 "prefetch_accuracy,prefetch_coverage\n");
+
+    for (const sweep_result_t &r : runs) {
+        for (const string &value : r.values) fprintf(out, "%s,", value.c_str());
+        fprintf(out, "%s,%.3f,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%.2f,%.2f,%ld,%ld,%ld,%ld,%.2f,%ld,%ld,%ld,%.2f,%.2f\n",
+                r.status == 0 ? "ok" : "error", r.seconds, r.reads, r.writes, r.evictions,
+                r.bus_responses, r.interconnect_traffic, r.max_cycles, r.total_cycles,
+                hitRate(r.l2_hits, r.l2_misses), hitRate(r.llc_hits, r.llc_misses),
+                r.memory_fetches, r.memory_writebacks, r.c2c_transfers, r.bus_wait,
+                hitRate(r.dram_row_hits, r.dram_requests - r.dram_row_hits), r.dram_wait,
+                r.remote_fetches, r.cross_socket, hitRate(r.prefetch_useful, r.prefetches - r.prefetch_useful),
+                hitRate(r.prefetch_useful, r.prefetch_misses));
+    }
+}
+
+// Write the results as a JSON array, one object per run
+inline void writeSweepJSON(FILE *out, const vector<sweep_param_t> &params,
+                           const vector<sweep_result_t> &runs) {
+    fprintf(out, "[\n");
+    for (size_t i = 0; i < runs.size(); i++) {
+        const sweep_result_t &r = runs[i];
+        fprintf(out, "  {");
+        for (size_t p = 0; p < params.size(); p++) {
+            fprintf(out, "\"%s\": \"%s\", ", params[p].key.c_str(), r.values[p].c_str());
+        }
+        fprintf(out, "\"status\": \"%s\", \"seconds\": %.3f, \"reads\": %ld, \"writes\": %ld, "
+                     "\"evictions\": %ld, \"bus_responses\": %ld, \"interconnect_traffic\": %ld, "
+                     "\"max_cycles\": %ld, \"total_cycles\": %ld, \"l2_hit_rate\": %.2f, "
+                     "\"llc_hit_rate\": %.2f, \"memory_fetches\": %ld, \"memory_writebacks\": %ld, "
+                     "\"c2c_transfers\": %ld, \"bus_wait\": %ld, \"dram_row_hit_rate\": %.2f, "
+                     "\"dram_wait\": %ld, \"remote_fetches\": %ld, \"cross_socket\": %ld, "
+                     "\"prefetch_accuracy\": %.2f, \"prefetch_coverage\": %.2f}%s\n",
+                r.status == 0 ? "ok" : "error", r.seconds, r.reads, r.writes, r.evictions,
+                r.bus_responses, r.interconnect_traffic, r.max_cycles, r.total_cycles,
+                hitRate(r.l2_hits, r.l2_misses), hitRate(r.llc_hits, r.llc_misses),
+                r.memory_fetches, r.memory_writebacks, r.c2c_transfers, r.bus_wait,
+                hitRate(r.dram_row_hits, r.dram_requests - r.dram_row_hits), r.dram_wait,
+                r.remote_fetches, r.cross_socket, hitRate(r.prefetch_useful, r.prefetches - r.prefetch_useful),
+                hitRate(r.prefetch_useful, r.prefetch_misses), i + 1 < runs.size() ? "," : "");
+    }
+    fprintf(out, "]\n");
+}
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <stdio.h>
+#include <queue>
+#include <vector>
+#include <unordered_map>
+#include "schedule.h"
+#include "trace.h"
+using namespace std;
+
+// Task table and per-core run queues
+//
+// The table indexes the loaded tasks by id, so replay never searches for a
+// task. Each task keeps its own read / write cursors (threadinfo_t). A run
+// queue holds the tasks of one core in run order and the index of the
+// running one, which only moves forward: pending -> running -> done.
+
+typedef struct {
+    vector<threadinfo_t *> dense;                 // Ids below dense.size()
+    unordered_map<long, threadinfo_t *> sparse;   // Outliers (very large ids)
+} task_table_t;
+
+typedef struct {
+    vector<threadinfo_t *> tasks;   // In run order
+    size_t next;                    // Running task, tasks.size() once done
+} run_queue_t;
+
+// Index tasks by id (the last entry wins if an id appears twice)
+// Ids are normally small and consecutive; any beyond a few times the task
+// count go to a hash map so that a stray id cannot blow up the table.
+inline int buildTaskTable(const vector<threadinfo_t *> &threads, task_table_t *table) {
+    long limit = 4 * (long)threads.size() + 1024;
+    long max_id = -1;
+
+    for (threadinfo_t *t : threads) {
+        if (t->thread_id < 0) {
+            printf("Invalid thread id %d\n", t->thread_id);
+            return -1;
+        }
+        if (t->thread_id < limit && t->thread_id > max_id) max_id = t->thread_id;
+    }
+
+    table->dense.assign(max_id + 1, NULL);
+    table->sparse.clear();
+    for (threadinfo_t *t : threads) {
+        if (t->thread_id <= max_id) table->dense[t->thread_id] = t;
+        else table->sparse[t->thread_id] = t;
+    }
+    return 0;
+}
+
+// Task with the given id, NULL if there is none
+static inline threadinfo_t *lookupTask(const task_table_t *table, long id) {
+    if (id >= 0 && id < (long)table->dense.size()) {
+        return table->dense[id];
+    }
+    if (table->sparse.empty()) {
+        return NULL;
+    }
+    auto it = table->sparse.find(id);
+    return it == table->sparse.end() ? NULL : it->second;
+}
+
+// One run queue per core from a schedule
+inline int buildRunQueues(const schedule_t &schedule, const task_table_t *table, int num_cores,
+                          vector<run_queue_t> &queues) {
+    queues.assign(num_cores, run_queue_t());
+
+    for (size_t core = 0; core < schedule.cores.size() && (int)core < num_cores; core++) {
+        for (int id : schedule.cores[core]) {
+            threadinfo_t *t = lookupTask(table, id);
+            if (t == NULL) {
+                printf("Thread Info not Found! Is thread_id %d correct?\n", id);
+                return -1;
+            }
+            queues[core].tasks.push_back(t);
+        }
+    }
+    return 0;
+}
+
+// Accesses executed per access replayed by the tasks of each queue, and over
+// all queues: above 1 where the trace was sampled
+inline void sampleScales(const vector<run_queue_t> &queues, vector<double> &scales, double *total) {
+    long all_recorded = 0, all_executed = 0;
+    scales.assign(queues.size(), 1.0);
+
+    for (size_t core = 0; core < queues.size(); core++) {
+        long recorded = 0, executed = 0;
+        for (const threadinfo_t *t : queues[core].tasks) {
+            recorded += t->accesses;
+            executed += t->sampled_from > t->accesses ? t->sampled_from : t->accesses;
+        }
+        if (recorded > 0) scales[core] = (double)executed / recorded;
+        all_recorded += recorded;
+        all_executed += executed;
+    }
+    *total = all_recorded > 0 ? (double)all_executed / all_recorded : 1.0;
+}
+
+// Running task of a queue, NULL once every task is done
+static inline threadinfo_t *queueTask(const run_queue_t *q) {
+    return q->next < q->tasks.size() ? q->tasks[q->next] : NULL;
+}
+
+// Move past the running task if it has replayed its whole trace
+static inline void queueAdvance(run_queue_t *q) {
+    threadinfo_t *t = q->tasks[q->next];
+    if (threadDone(t)) {
+        threadRelease(t);
+        q->next += 1;
+    }
+}
+
+// Cores of the event engine, ordered by cycle count
+// The earliest core runs next; ties go to the lowest core so cores with
+// equal clocks keep the round-robin order. A core's clock also advances
+// while it answers snoops, so an entry's cycle may be behind the core's:
+// the engine re-queues such entries when they come up (clocks only grow).
+typedef struct {
+    long cycle;
+    int  core;
+} core_event_t;
+
+struct CoreEventLater {
+    bool operator()(const core_event_t &a, const core_event_t &b) const {
+        return a.cycle != b.cycle ? a.cycle > b.cycle : a.core > b.core;
+    }
+};
+
+typedef priority_queue<core_event_t, vector<core_event_t>, CoreEventLater> core_events_t;
+
+#endif
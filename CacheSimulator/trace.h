@@ -0,0 +1,870 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include <algorithm>
+#include "trace_format.h"
+#include "trace_codec.h"
+using namespace std;
+
+// Bounded window over one packed list of a binary trace file
+//
+// Used in streaming mode: the list stays on disk and is paged in chunk
+// elements (addresses or access records) at a time, into a buffer that only
+// exists while the owning task is running. Encoded access lists are read
+// into a small input buffer and decoded chunk records at a time.
+//
+// Encoded lists of a mapped trace are decoded the same way, straight from
+// the mapping (data), and so are raw access lists of versions before 5
+// (widened to the current record). These streams remember where their
+// current chunk started, so a replay can go back to an earlier position.
+#define TRACE_DECODE_CHUNK 4096     // Records decoded at a time from a mapping
+
+typedef struct {
+    int      fd;          // Trace file
+    size_t   elem;        // Bytes per element
+    size_t   disk_elem;   // Bytes per element in the file (older access
+                          // records are narrower)
+    long     chunk;       // Elements per refill
+    uint64_t offset;      // File offset of the next unread element (byte)
+    uint64_t remaining;   // Elements not yet read (decoded) from disk
+    char    *buf;         // Current chunk, NULL while the task is idle
+    trace_decoder_t *decoder;  // Encoded list state, NULL for raw lists
+    uint8_t *in;          // Encoded bytes read ahead
+    size_t   in_cap;
+    size_t   in_pos;
+    size_t   in_len;
+    uint64_t packed_left; // Encoded bytes not yet read from disk
+    int      error;       // A read or decode failed, the list is cut short
+    uint64_t count;       // Elements in the whole list
+    uint32_t version;     // Of the trace file
+    const uint8_t *data;  // List within a mapping, NULL if read from fd
+    const uint8_t *data_end;
+    trace_decoder_t *mark;     // Mapped lists: decoder at the current chunk
+    uint64_t mark_offset;
+    uint64_t mark_remaining;
+} trace_stream_t;
+
+// Struct containing info for each thread
+//
+// read_list / write_list point into a mapped binary trace, into the owned
+// storage vectors (text traces) or into the current stream chunk
+// (streaming mode). read_pos / write_pos are the replay cursors within
+// those lists. Ordered traces fill access_list (same storage rules)
+// instead, with the accesses in program order; encoded lists of a mapped
+// trace are decoded a chunk at a time through access_stream. accesses
+// counts what the trace recorded; a sampled trace also keeps how many were
+// executed.
+typedef struct ThreadInfo{
+  int thread_id;
+  long instr_count;
+  long accesses;
+  long sampled_from;
+  const long *read_list;
+  long read_count;
+  long read_pos;
+  const long *write_list;
+  long write_count;
+  long write_pos;
+  const trace_access_t *access_list;
+  long access_count;
+  long access_pos;
+  vector<long> read_storage;
+  vector<long> write_storage;
+  vector<trace_access_t> access_storage;
+  trace_stream_t *read_stream;
+  trace_stream_t *write_stream;
+  trace_stream_t *access_stream;
+  int has_ip;             // Ordered accesses carry instruction addresses
+} threadinfo_t;
+
+// Mapping of a binary trace file
+typedef struct {
+    void  *base;
+    size_t size;
+} trace_map_t;
+
+/* ===================================================================== */
+/* Text trace reader                                                     */
+/* ===================================================================== */
+
+// Incremental reader for the Pin text formats
+//
+//   (tid, instr_count, [(op, addr, size, icount_delta, ip), ...])   ordered
+//   (tid, instr_count, [r0, r1, ...], [w0, w1, ...])                reads / writes
+//   ...
+//   #eof
+//
+// op is TRACE_OP_READ or TRACE_OP_WRITE; ip, the address of the accessing
+// instruction, is left out by older traces. Addresses and accesses are
+// returned one at a time so that a single (possibly multi-GB) line never has
+// to be held in memory.
+typedef struct {
+    FILE *fptr;
+    int   ips;      // Every access of the current thread so far had an ip
+} text_trace_t;
+
+static inline int textSkipTo(text_trace_t *t, char target) {
+    int c;
+    while ((c = getc_unlocked(t->fptr)) != EOF) {
+        if (c == target) return 0;
+    }
+    return -1;
+}
+
+static inline int textReadNumber(text_trace_t *t, long *value, int *next) {
+    int c = getc_unlocked(t->fptr);
+    while (c == ' ' || c == ',' || c == '\t') c = getc_unlocked(t->fptr);
+
+    int negative = 0;
+    if (c == '-') {
+        negative = 1;
+        c = getc_unlocked(t->fptr);
+    }
+    if (c < '0' || c > '9') {
+        *next = c;
+        return 0;
+    }
+
+    unsigned long v = 0;
+    while (c >= '0' && c <= '9') {
+        v = v * 10 + (c - '0');
+        c = getc_unlocked(t->fptr);
+    }
+    *value = negative ? -(long)v : (long)v;
+    *next = c;
+    return 1;
+}
+
+// Read "(tid, instr_count, [" of the next thread
+// Returns 1 if a thread follows, 0 at #eof / end of file, -1 on bad input
+static inline int textNextThread(text_trace_t *t, long *thread_id, long *instr_count) {
+    int c = getc_unlocked(t->fptr);
+    while (c == ' ' || c == '\n' || c == '\r' || c == '\t') c = getc_unlocked(t->fptr);
+
+    if (c == EOF || c == '#') return 0;
+    if (c != '(') return -1;
+    t->ips = 1;
+
+    int next;
+    if (!textReadNumber(t, thread_id, &next)) return -1;
+    if (!textReadNumber(t, instr_count, &next)) return -1;
+    if (next != '[' && textSkipTo(t, '[') == -1) return -1;
+    return 1;
+}
+
+// Read the next address of the current list
+// Returns 1 for an address, 0 at the closing ']', -1 on bad input
+static inline int textNextAddress(text_trace_t *t, long *addr) {
+    int next;
+    if (textReadNumber(t, addr, &next)) {
+        if (next == ']') ungetc(next, t->fptr);
+        return 1;
+    }
+    return next == ']' ? 0 : -1;
+}
+
+// Whether the list just opened holds ordered accesses
+static inline int textOrderedList(text_trace_t *t) {
+    int c = getc_unlocked(t->fptr);
+    while (c == ' ' || c == '\t') c = getc_unlocked(t->fptr);
+    ungetc(c, t->fptr);
+    return c == '(';
+}
+
+// Read the next "(op, addr, size, icount_delta[, ip])" of an ordered list
+// Returns 1 for an access, 0 at the closing ']', -1 on bad input
+static inline int textNextAccess(text_trace_t *t, trace_access_t *access) {
+    int c = getc_unlocked(t->fptr);
+    while (c == ' ' || c == ',' || c == '\t') c = getc_unlocked(t->fptr);
+    if (c == ']') return 0;
+    if (c != '(') return -1;
+
+    long v[5] = {0};
+    int next;
+    for (int i = 0; i < 4; i++) {
+        if (!textReadNumber(t, &v[i], &next)) return -1;
+    }
+    if (next == ',') {
+        if (!textReadNumber(t, &v[4], &next)) return -1;
+    }
+    else {
+        t->ips = 0;
+    }
+    if (next != ')' || (v[0] != TRACE_OP_READ && v[0] != TRACE_OP_WRITE)) return -1;
+
+    access->op = v[0];
+    access->addr = v[1];
+    access->size = v[2];
+    access->icount_delta = v[3];
+    access->pad = 0;
+    access->ip = v[4];
+    return 1;
+}
+
+// Move from the end of the read list to the start of the write list
+// Returns 0 at the write list, 1 if the line has a single list (an empty
+// ordered list), -1 on bad input
+static inline int textNextList(text_trace_t *t) {
+    int c = getc_unlocked(t->fptr);
+    while (c == ' ' || c == ',' || c == '\t') c = getc_unlocked(t->fptr);
+    if (c == '[') return 0;
+    return c == ')' ? 1 : -1;
+}
+
+// Skip the rest of the current thread's line
+static inline int textEndThread(text_trace_t *t) {
+    return textSkipTo(t, '\n') == -1 && !feof(t->fptr) ? -1 : 0;
+}
+
+// Parse a text trace into thread_list, copying every address
+inline int readTextTrace(const char *path, vector<threadinfo_t *> &thread_list) {
+
+    text_trace_t t;
+    t.fptr = fopen(path, "r");
+
+    if (t.fptr == NULL) {
+        printf("Error Opening Trace File!\n");
+        return -1;
+    }
+
+    long thread_id, instr_count, addr;
+    trace_access_t access;
+    int ret;
+
+    while ((ret = textNextThread(&t, &thread_id, &instr_count)) == 1) {
+
+        // Struct containing info about trace
+        threadinfo_t *this_thread_info = new threadinfo_t();
+        this_thread_info->thread_id = thread_id;
+        this_thread_info->instr_count = instr_count;
+
+        if (textOrderedList(&t)) {
+            // Parse ordered accesses
+            while ((ret = textNextAccess(&t, &access)) == 1) {
+                this_thread_info->access_storage.push_back(access);
+            }
+        }
+        else {
+            // Parse read list
+            while ((ret = textNextAddress(&t, &addr)) == 1) {
+                this_thread_info->read_storage.push_back(addr);
+            }
+
+            // Parse write list
+            if (ret == 0 && textNextList(&t) == 0) {
+                while ((ret = textNextAddress(&t, &addr)) == 1) {
+                    this_thread_info->write_storage.push_back(addr);
+                }
+            }
+        }
+
+        if (ret != 0 || textEndThread(&t) == -1) {
+            printf("Malformed trace entry for thread %ld\n", thread_id);
+            delete this_thread_info;
+            fclose(t.fptr);
+            return -1;
+        }
+
+        this_thread_info->read_list = this_thread_info->read_storage.data();
+        this_thread_info->read_count = this_thread_info->read_storage.size();
+        this_thread_info->write_list = this_thread_info->write_storage.data();
+        this_thread_info->write_count = this_thread_info->write_storage.size();
+        if (!this_thread_info->access_storage.empty()) {
+            this_thread_info->access_list = this_thread_info->access_storage.data();
+            this_thread_info->access_count = this_thread_info->access_storage.size();
+            this_thread_info->has_ip = t.ips;
+        }
+        this_thread_info->accesses = this_thread_info->read_count + this_thread_info->write_count +
+                                     this_thread_info->access_count;
+
+        // Store thread info
+        thread_list.push_back(this_thread_info);
+    }
+
+    fclose(t.fptr);
+
+    if (ret == -1) {
+        printf("Malformed trace file!\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* ===================================================================== */
+/* Binary trace reader                                                   */
+/* ===================================================================== */
+
+// Check whether path starts with the binary trace magic
+inline int isBinaryTrace(const char *path) {
+    char magic[TRACE_MAGIC_LEN];
+
+    FILE *fptr = fopen(path, "rb");
+    if (fptr == NULL) return 0;
+
+    size_t n = fread(magic, 1, TRACE_MAGIC_LEN, fptr);
+    fclose(fptr);
+
+    return n == TRACE_MAGIC_LEN && memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0;
+}
+
+// Check the header of a binary trace
+static inline int checkTraceHeader(const trace_header_t *header) {
+    if (memcmp(header->magic, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0 ||
+        header->version < 1 || header->version > TRACE_VERSION) {
+        printf("Unsupported trace version %u\n", header->version);
+        return -1;
+    }
+    return 0;
+}
+
+// Whether count elements of size bytes at offset lie within limit bytes
+static inline int traceInBounds(uint64_t offset, uint64_t count, size_t size, size_t limit) {
+    return offset <= limit && (limit - offset) / size >= count;
+}
+
+// Whether the lists of an index entry lie within a file of limit bytes
+static inline int traceEntryInBounds(const trace_index_t *entry, uint32_t version, size_t limit) {
+    return traceInBounds(entry->read_offset, entry->read_count, sizeof(int64_t), limit) &&
+           traceInBounds(entry->write_offset, entry->write_count, sizeof(int64_t), limit) &&
+           (entry->packed_size > 0
+                ? traceInBounds(entry->access_offset, entry->packed_size, 1, limit)
+                : traceInBounds(entry->access_offset, entry->access_count, traceAccessSize(version), limit));
+}
+
+static inline trace_stream_t *newMappedStream(const uint8_t *data, uint64_t count, uint64_t packed_size,
+                                              uint32_t version);
+
+// mmap a binary trace and point thread_list at the packed arrays
+// No addresses are copied: encoded (and older raw) access lists are decoded
+// a chunk at a time as they are replayed. The mapping must outlive
+// thread_list.
+inline int mapBinaryTrace(const char *path, trace_map_t *map, vector<threadinfo_t *> &thread_list) {
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        printf("Error Opening Trace File!\n");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(trace_header_t)) {
+        printf("Trace file too small!\n");
+        close(fd);
+        return -1;
+    }
+
+    map->size = st.st_size;
+    map->base = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map->base == MAP_FAILED) {
+        printf("Error mapping Trace File!\n");
+        map->base = NULL;
+        return -1;
+    }
+
+    const char *base = (const char *)map->base;
+    const trace_header_t *header = (const trace_header_t *)base;
+
+    if (checkTraceHeader(header) == -1) {
+        return -1;
+    }
+
+    if (!traceInBounds(header->index_offset, header->num_threads, traceIndexSize(header->version), map->size)) {
+        printf("Trace index out of bounds!\n");
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < header->num_threads; i++) {
+        trace_index_t entry;
+        traceIndexEntry(base + header->index_offset, header->version, i, &entry);
+
+        if (!traceEntryInBounds(&entry, header->version, map->size)) {
+            printf("Trace data for thread %ld out of bounds!\n", (long)entry.thread_id);
+            return -1;
+        }
+
+        threadinfo_t *this_thread_info = new threadinfo_t();
+        this_thread_info->thread_id = entry.thread_id;
+        this_thread_info->instr_count = entry.instr_count;
+        this_thread_info->accesses = entry.access_count + entry.read_count + entry.write_count;
+        this_thread_info->sampled_from = entry.sampled_from;
+        this_thread_info->read_list = (const long *)(base + entry.read_offset);
+        this_thread_info->read_count = entry.read_count;
+        this_thread_info->write_list = (const long *)(base + entry.write_offset);
+        this_thread_info->write_count = entry.write_count;
+        this_thread_info->has_ip = (entry.flags & TRACE_FLAG_IP) != 0;
+        if (entry.packed_size > 0 || (entry.access_count > 0 && header->version < 5)) {
+            this_thread_info->access_stream = newMappedStream((const uint8_t *)(base + entry.access_offset),
+                                                              entry.access_count, entry.packed_size,
+                                                              header->version);
+        }
+        else if (entry.access_count > 0) {
+            this_thread_info->access_list = (const trace_access_t *)(base + entry.access_offset);
+            this_thread_info->access_count = entry.access_count;
+        }
+
+        thread_list.push_back(this_thread_info);
+    }
+
+    return 0;
+}
+
+inline void unmapBinaryTrace(trace_map_t *map) {
+    if (map->base != NULL) {
+        munmap(map->base, map->size);
+        map->base = NULL;
+    }
+}
+
+/* ===================================================================== */
+/* Streaming binary trace reader                                         */
+/* ===================================================================== */
+
+static inline int readFully(int fd, void *buf, size_t size, uint64_t offset) {
+    char *p = (char *)buf;
+    while (size > 0) {
+        ssize_t n = pread(fd, p, size, offset);
+        if (n <= 0) return -1;
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static inline trace_stream_t *newStream(int fd, size_t elem, long chunk, uint64_t offset, uint64_t count) {
+    trace_stream_t *s = new trace_stream_t();
+    s->fd = fd;
+    s->elem = elem;
+    s->disk_elem = elem;
+    s->chunk = chunk;
+    s->offset = offset;
+    s->remaining = count;
+    s->buf = NULL;
+    s->decoder = NULL;
+    s->in = NULL;
+    s->error = 0;
+    s->count = count;
+    s->version = TRACE_VERSION;
+    s->data = NULL;
+    s->mark = NULL;
+    return s;
+}
+
+// Stream of count encoded accesses stored in packed_size bytes at offset
+static inline trace_stream_t *newEncodedStream(int fd, long chunk, uint64_t offset, uint64_t count,
+                                               uint64_t packed_size, uint32_t version) {
+    trace_stream_t *s = newStream(fd, sizeof(trace_access_t), chunk, offset, count);
+    s->version = version;
+    s->decoder = new trace_decoder_t();
+    decoderInit(s->decoder, version >= 5);
+    s->in_cap = max(chunk * sizeof(trace_access_t) / 4, (size_t)(4 * CODEC_MAX_TOKEN));
+    s->in_pos = 0;
+    s->in_len = 0;
+    s->packed_left = packed_size;
+    return s;
+}
+
+// Stream of count accesses of a mapping, stored encoded in packed_size
+// bytes, or as raw records of an older version if packed_size is 0
+static inline trace_stream_t *newMappedStream(const uint8_t *data, uint64_t count, uint64_t packed_size,
+                                              uint32_t version) {
+    trace_stream_t *s = newStream(-1, sizeof(trace_access_t), TRACE_DECODE_CHUNK, 0, count);
+    s->version = version;
+    s->data = data;
+    s->mark_offset = 0;
+    s->mark_remaining = count;
+    if (packed_size == 0) {
+        s->disk_elem = traceAccessSize(version);
+        s->data_end = data + count * s->disk_elem;
+        return s;
+    }
+    s->data_end = data + packed_size;
+    s->decoder = new trace_decoder_t();
+    decoderInit(s->decoder, version >= 5);
+    s->mark = new trace_decoder_t();
+    *s->mark = *s->decoder;
+    return s;
+}
+
+// Widen n raw access records of an older version, packed at the start of
+// buf, to the current layout (no instruction addresses)
+static inline void widenAccesses(char *buf, long n) {
+    for (long i = n - 1; i >= 0; i--) {
+        trace_access_t a;
+        memset(&a, 0, sizeof(a));
+        memcpy(&a, buf + i * TRACE_ACCESS_V4_SIZE, TRACE_ACCESS_V4_SIZE);
+        memcpy(buf + i * sizeof(trace_access_t), &a, sizeof(a));
+    }
+}
+
+// Decode the next chunk of an encoded stream into s->buf
+static inline long decodeStream(trace_stream_t *s, long n) {
+    trace_access_t *out = (trace_access_t *)s->buf;
+
+    if (s->data != NULL) {
+        const uint8_t *p = s->data + s->offset;
+        for (long i = 0; i < n; i++) {
+            if (decoderNext(s->decoder, &p, s->data_end, &out[i]) != 1) return -1;
+        }
+        s->offset = p - s->data;
+        return n;
+    }
+
+    if (s->in == NULL) {
+        s->in = (uint8_t *)malloc(s->in_cap);
+    }
+
+    for (long i = 0; i < n; i++) {
+        // Keep a whole record ahead unless the list ends sooner
+        if (s->in_len - s->in_pos < CODEC_MAX_TOKEN && s->packed_left > 0) {
+            memmove(s->in, s->in + s->in_pos, s->in_len - s->in_pos);
+            s->in_len -= s->in_pos;
+            s->in_pos = 0;
+
+            size_t want = s->in_cap - s->in_len;
+            if (want > s->packed_left) want = s->packed_left;
+            if (readFully(s->fd, s->in + s->in_len, want, s->offset) == -1) return -1;
+            s->offset += want;
+            s->packed_left -= want;
+            s->in_len += want;
+        }
+
+        const uint8_t *p = s->in + s->in_pos;
+        if (decoderNext(s->decoder, &p, s->in + s->in_len, &out[i]) != 1) return -1;
+        s->in_pos = p - s->in;
+    }
+    return n;
+}
+
+// Page the next chunk of a stream into *list
+// Returns the number of elements loaded, 0 once the stream is exhausted.
+// A failed read also ends the stream, and leaves s->error set.
+static inline long refillStream(trace_stream_t *s, const void **list, long *count, long *pos) {
+    if (s == NULL || s->remaining == 0) return 0;
+
+    if (s->buf == NULL) {
+        s->buf = (char *)malloc(s->chunk * s->elem);
+    }
+
+    long n = s->remaining < (uint64_t)s->chunk ? (long)s->remaining : s->chunk;
+    if (s->data != NULL) {
+        // Where this chunk starts, to come back to
+        if (s->mark != NULL) *s->mark = *s->decoder;
+        s->mark_offset = s->offset;
+        s->mark_remaining = s->remaining;
+    }
+
+    if (s->decoder != NULL) {
+        if (decodeStream(s, n) == -1) {
+            printf("Error decoding Trace File at offset %lu!\n", (unsigned long)s->offset);
+            s->remaining = 0;
+            s->error = 1;
+            return 0;
+        }
+    }
+    else {
+        if (s->data != NULL) {
+            memcpy(s->buf, s->data + s->offset, n * s->disk_elem);
+        }
+        else if (readFully(s->fd, s->buf, n * s->disk_elem, s->offset) == -1) {
+            printf("Error reading Trace File at offset %lu!\n", (unsigned long)s->offset);
+            s->remaining = 0;
+            s->error = 1;
+            return 0;
+        }
+        s->offset += n * s->disk_elem;
+        if (s->disk_elem != s->elem) widenAccesses(s->buf, n);
+    }
+    s->remaining -= n;
+
+    *list = s->buf;
+    *count = n;
+    *pos = 0;
+    return n;
+}
+
+// Open a binary trace for streaming
+// Only the header and index are read; every list is paged in on demand,
+// and at most window bytes of addresses are resident for num_active
+// concurrently running threads.
+inline int openStreamTrace(const char *path, long window, int num_active, int *trace_fd,
+                           vector<threadinfo_t *> &thread_list) {
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        printf("Error Opening Trace File!\n");
+        return -1;
+    }
+
+    trace_header_t header;
+    if (readFully(fd, &header, sizeof(header), 0) == -1 ||
+        memcmp(header.magic, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0) {
+        printf("Streaming requires a binary trace (see tracecvt)\n");
+        close(fd);
+        return -1;
+    }
+    if (checkTraceHeader(&header) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        printf("Error Opening Trace File!\n");
+        close(fd);
+        return -1;
+    }
+    if (!traceInBounds(header.index_offset, header.num_threads, traceIndexSize(header.version), st.st_size)) {
+        printf("Trace index out of bounds!\n");
+        close(fd);
+        return -1;
+    }
+
+    vector<char> index(header.num_threads * traceIndexSize(header.version));
+    if (readFully(fd, index.data(), index.size(), header.index_offset) == -1) {
+        printf("Trace index out of bounds!\n");
+        close(fd);
+        return -1;
+    }
+
+    // The streams of the running threads share the window: two (read +
+    // write) per thread, or one for ordered accesses
+    long share = window / num_active;
+
+    for (uint32_t i = 0; i < header.num_threads; i++) {
+        trace_index_t entry;
+        traceIndexEntry(index.data(), header.version, i, &entry);
+
+        if (!traceEntryInBounds(&entry, header.version, st.st_size)) {
+            printf("Trace data for thread %ld out of bounds!\n", (long)entry.thread_id);
+            close(fd);
+            return -1;
+        }
+
+        threadinfo_t *this_thread_info = new threadinfo_t();
+        this_thread_info->thread_id = entry.thread_id;
+        this_thread_info->instr_count = entry.instr_count;
+        this_thread_info->accesses = entry.access_count + entry.read_count + entry.write_count;
+        this_thread_info->sampled_from = entry.sampled_from;
+        this_thread_info->has_ip = (entry.flags & TRACE_FLAG_IP) != 0;
+        if (entry.packed_size > 0) {
+            // The decoded chunk takes most of the share, the encoded input the rest
+            long chunk = max(share * 4 / 5 / (long)sizeof(trace_access_t), 1L);
+            this_thread_info->access_stream = newEncodedStream(fd, chunk, entry.access_offset, entry.access_count,
+                                                               entry.packed_size, header.version);
+        }
+        else if (entry.access_count > 0) {
+            long chunk = max(share / (long)sizeof(trace_access_t), 1L);
+            this_thread_info->access_stream = newStream(fd, sizeof(trace_access_t), chunk,
+                                                        entry.access_offset, entry.access_count);
+            this_thread_info->access_stream->disk_elem = traceAccessSize(header.version);
+        }
+        else {
+            long chunk = max(share / (2 * (long)sizeof(long)), 1L);
+            this_thread_info->read_stream = newStream(fd, sizeof(long), chunk, entry.read_offset, entry.read_count);
+            this_thread_info->write_stream = newStream(fd, sizeof(long), chunk, entry.write_offset, entry.write_count);
+        }
+
+        thread_list.push_back(this_thread_info);
+    }
+
+    *trace_fd = fd;
+    return 0;
+}
+
+/* ===================================================================== */
+/* Replay helpers                                                        */
+/* ===================================================================== */
+
+// Fetch the next read address of a thread, returns 0 when none are left
+static inline int threadNextRead(threadinfo_t *t, long *addr) {
+    if (t->read_pos == t->read_count &&
+        refillStream(t->read_stream, (const void **)&t->read_list, &t->read_count, &t->read_pos) == 0) {
+        return 0;
+    }
+    *addr = t->read_list[t->read_pos++];
+    return 1;
+}
+
+// Fetch the next write address of a thread, returns 0 when none are left
+static inline int threadNextWrite(threadinfo_t *t, long *addr) {
+    if (t->write_pos == t->write_count &&
+        refillStream(t->write_stream, (const void **)&t->write_list, &t->write_count, &t->write_pos) == 0) {
+        return 0;
+    }
+    *addr = t->write_list[t->write_pos++];
+    return 1;
+}
+
+// Whether a thread has an ordered access stream
+static inline int threadOrdered(const threadinfo_t *t) {
+    return t->access_list != NULL || t->access_stream != NULL;
+}
+
+// Fetch the next access of an ordered thread, returns 0 when none are left
+static inline int threadNextAccess(threadinfo_t *t, trace_access_t *access) {
+    if (t->access_pos == t->access_count &&
+        refillStream(t->access_stream, (const void **)&t->access_list, &t->access_count, &t->access_pos) == 0) {
+        return 0;
+    }
+    *access = t->access_list[t->access_pos++];
+    return 1;
+}
+
+// Whether a thread has replayed its whole trace
+static inline int threadDone(threadinfo_t *t) {
+    return t->read_pos == t->read_count &&
+           t->write_pos == t->write_count &&
+           t->access_pos == t->access_count &&
+           (t->read_stream == NULL || t->read_stream->remaining == 0) &&
+           (t->write_stream == NULL || t->write_stream->remaining == 0) &&
+           (t->access_stream == NULL || t->access_stream->remaining == 0);
+}
+
+// Whether a stream of a thread failed, its trace was not replayed in full
+static inline int threadFailed(const threadinfo_t *t) {
+    return (t->read_stream != NULL && t->read_stream->error) ||
+           (t->write_stream != NULL && t->write_stream->error) ||
+           (t->access_stream != NULL && t->access_stream->error);
+}
+
+// Free the stream chunks of a thread that has stopped running
+static inline void threadRelease(threadinfo_t *t) {
+    trace_stream_t *streams[3] = {t->read_stream, t->write_stream, t->access_stream};
+    for (trace_stream_t *s : streams) {
+        if (s != NULL && s->buf != NULL) {
+            free(s->buf);
+            s->buf = NULL;
+        }
+        if (s != NULL && s->in != NULL) {
+            free(s->in);
+            s->in = NULL;
+        }
+    }
+    if (t->read_stream != NULL) {
+        t->read_list = NULL;
+        t->read_count = t->read_pos = 0;
+    }
+    if (t->write_stream != NULL) {
+        t->write_list = NULL;
+        t->write_count = t->write_pos = 0;
+    }
+    if (t->access_stream != NULL) {
+        t->access_list = NULL;
+        t->access_count = t->access_pos = 0;
+    }
+}
+
+// Free a thread and the streams it owns (the trace file stays open)
+inline void deleteThread(threadinfo_t *t) {
+    threadRelease(t);
+    trace_stream_t *streams[3] = {t->read_stream, t->write_stream, t->access_stream};
+    for (trace_stream_t *s : streams) {
+        if (s == NULL) continue;
+        delete s->decoder;
+        delete s->mark;
+        delete s;
+    }
+    delete t;
+}
+
+// Replay position of a loaded (mapped or text) thread, to return to
+typedef struct {
+    long read_pos;
+    long write_pos;
+    long access_pos;
+    int  loaded;                // A chunk of a mapped list stream was decoded
+    trace_decoder_t decoder;    // Decoder at the start of that chunk (encoded)
+    uint64_t offset;
+    uint64_t remaining;
+} thread_mark_t;
+
+static inline void threadMark(const threadinfo_t *t, thread_mark_t *m) {
+    m->read_pos = t->read_pos;
+    m->write_pos = t->write_pos;
+    m->access_pos = t->access_pos;
+
+    const trace_stream_t *s = t->access_stream;
+    m->loaded = s != NULL && s->data != NULL && t->access_count > 0;
+    if (m->loaded) {
+        if (s->mark != NULL) m->decoder = *s->mark;
+        m->offset = s->mark_offset;
+        m->remaining = s->mark_remaining;
+    }
+}
+
+// Go back to the start of a thread's trace
+static inline void threadRewind(threadinfo_t *t) {
+    t->read_pos = 0;
+    t->write_pos = 0;
+    t->access_pos = 0;
+
+    trace_stream_t *s = t->access_stream;
+    if (s != NULL && s->data != NULL) {
+        if (s->decoder != NULL) decoderInit(s->decoder, s->decoder->ips);
+        s->offset = 0;
+        s->remaining = s->count;
+        t->access_count = 0;
+    }
+}
+
+// Go back to a position of threadMark, re-decoding its chunk
+static inline void threadSeek(threadinfo_t *t, const thread_mark_t *m) {
+    if (m->loaded) {
+        trace_stream_t *s = t->access_stream;
+        if (s->decoder != NULL) *s->decoder = m->decoder;
+        s->offset = m->offset;
+        s->remaining = m->remaining;
+        refillStream(s, (const void **)&t->access_list, &t->access_count, &t->access_pos);
+    }
+    t->read_pos = m->read_pos;
+    t->write_pos = m->write_pos;
+    t->access_pos = m->access_pos;
+}
+
+// Independent replay cursor over a loaded (mapped or text) thread
+// The view shares the address lists, so several simulations can replay the
+// same trace at once; list streams of a mapping get a stream of their own.
+// Not for streamed traces.
+inline threadinfo_t *threadView(const threadinfo_t *t) {
+    threadinfo_t *view = new threadinfo_t();
+    view->thread_id = t->thread_id;
+    view->instr_count = t->instr_count;
+    view->accesses = t->accesses;
+    view->sampled_from = t->sampled_from;
+    view->read_list = t->read_list;
+    view->read_count = t->read_count;
+    view->read_pos = 0;
+    view->write_list = t->write_list;
+    view->write_count = t->write_count;
+    view->write_pos = 0;
+    view->access_list = t->access_list;
+    view->access_count = t->access_count;
+    view->access_pos = 0;
+    view->read_stream = NULL;
+    view->write_stream = NULL;
+    view->access_stream = NULL;
+    view->has_ip = t->has_ip;
+
+    const trace_stream_t *s = t->access_stream;
+    if (s != NULL && s->data != NULL) {
+        view->access_list = NULL;
+        view->access_count = 0;
+        view->access_stream = newMappedStream(s->data, s->count, s->decoder != NULL ? s->data_end - s->data : 0,
+                                              s->version);
+    }
+    return view;
+}
+
+#endif
@@ -0,0 +1,363 @@
+#ifndef TRACE_CODEC_H
+#define TRACE_CODEC_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "trace_format.h"
+using namespace std;
+
+// Compact encoding of an ordered access stream
+//
+// Both sides track a small table of address streams. Each access becomes a
+// token against that table:
+//
+//   hit      the stream's next address (last + stride), same op, size and
+//            instruction
+//   literal  anything else: a stream, op, size and the address and
+//            instruction as deltas from that stream's last ones (the stride
+//            becomes the address delta)
+//
+// Loop bodies produce the same tokens over and over, so a repeat record
+// replays the previous n tokens from up to CODEC_WINDOW tokens back: a
+// strided loop touching a few arrays collapses into one record. Token bytes
+// (little-endian base-128 varints, zigzag for signed values):
+//
+//   00 sss ddd                 hit on stream s, icount_delta d (7: varint follows)
+//   01 sss o zz  delta icount ip
+//                              literal, op o, size code z (3: varint size
+//                              follows); no ip delta before version 5
+//   10 kkkkkk    n             repeat the n tokens starting k + 1 tokens back
+//
+// The encoder and decoder apply the same tokens to the same state, so any
+// token sequence decodes to exactly the accesses it was made from.
+
+#define CODEC_STREAMS   8
+#define CODEC_WINDOW    64
+#define CODEC_MIN_RUN   2       // Shorter matches are cheaper as tokens
+#define CODEC_MAX_TOKEN 32      // Longest encoding of a single record
+
+typedef enum
+{
+    CodecHit,
+    CodecLiteral
+} codec_kind_t;
+
+typedef struct {
+    uint8_t  kind;              // codec_kind_t
+    uint8_t  stream;
+    uint8_t  op;
+    uint16_t size;
+    int64_t  delta;             // Literal: address - stream's last address
+    int64_t  ip_delta;          // Literal: instruction - stream's last one
+    uint32_t icount_delta;
+} codec_token_t;
+
+typedef struct {
+    int64_t  last;
+    int64_t  stride;
+    uint64_t ip;
+    uint16_t size;
+    uint8_t  op;
+} codec_stream_t;
+
+// State shared by the encoder and the decoder
+typedef struct {
+    codec_stream_t streams[CODEC_STREAMS];
+    codec_token_t  history[CODEC_WINDOW];
+    uint64_t       tokens;      // Tokens applied so far
+} codec_state_t;
+
+static inline void codecInit(codec_state_t *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+static inline int codecTokenEqual(const codec_token_t *a, const codec_token_t *b) {
+    return a->kind == b->kind && a->stream == b->stream && a->icount_delta == b->icount_delta &&
+           (a->kind == CodecHit ||
+            (a->op == b->op && a->size == b->size && a->delta == b->delta && a->ip_delta == b->ip_delta));
+}
+
+// Apply a token: produce its access and update the state
+static inline void codecApply(codec_state_t *s, const codec_token_t *t, trace_access_t *access) {
+    codec_stream_t *st = &s->streams[t->stream];
+
+    if (t->kind == CodecHit) {
+        st->last += st->stride;
+    }
+    else {
+        st->stride = t->delta;
+        st->last += t->delta;
+        st->ip += t->ip_delta;
+        st->op = t->op;
+        st->size = t->size;
+    }
+
+    access->addr = st->last;
+    access->ip = st->ip;
+    access->icount_delta = t->icount_delta;
+    access->size = st->size;
+    access->op = st->op;
+    access->pad = 0;
+
+    s->history[s->tokens % CODEC_WINDOW] = *t;
+    s->tokens += 1;
+}
+
+/* ===================================================================== */
+/* Encoder                                                               */
+/* ===================================================================== */
+
+typedef struct {
+    codec_state_t state;
+    int      victim;            // Next stream replaced by a far literal
+    int      match_dist;        // Current repeat candidate (0 = none)
+    uint64_t match_len;
+} trace_encoder_t;
+
+static inline void encoderInit(trace_encoder_t *e) {
+    codecInit(&e->state);
+    e->victim = 0;
+    e->match_dist = 0;
+    e->match_len = 0;
+}
+
+static inline void codecPutVarint(vector<uint8_t> &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static inline uint64_t codecZigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline void codecPutToken(vector<uint8_t> &out, const codec_token_t *t) {
+    if (t->kind == CodecHit) {
+        int d = t->icount_delta < 7 ? t->icount_delta : 7;
+        out.push_back((uint8_t)((t->stream << 3) | d));
+        if (d == 7) codecPutVarint(out, t->icount_delta);
+        return;
+    }
+
+    int z = t->size == 8 ? 0 : t->size == 4 ? 1 : t->size == 1 ? 2 : 3;
+    out.push_back((uint8_t)(0x40 | (t->stream << 3) | (t->op << 2) | z));
+    if (z == 3) codecPutVarint(out, t->size);
+    codecPutVarint(out, codecZigzag(t->delta));
+    codecPutVarint(out, t->icount_delta);
+    codecPutVarint(out, codecZigzag(t->ip_delta));
+}
+
+// Token for the next access given the current stream table
+static inline codec_token_t encoderToken(trace_encoder_t *e, const trace_access_t *access) {
+    codec_token_t t;
+    memset(&t, 0, sizeof(t));
+    t.icount_delta = access->icount_delta;
+
+    // Predicted by a stream
+    for (int i = 0; i < CODEC_STREAMS; i++) {
+        const codec_stream_t *st = &e->state.streams[i];
+        if (st->op == access->op && st->size == access->size && st->ip == access->ip &&
+            st->last + st->stride == access->addr) {
+            t.kind = CodecHit;
+            t.stream = i;
+            return t;
+        }
+    }
+
+    // Closest stream of the same kind (of the same instruction if there is
+    // one), or a new one if none is near
+    int best = -1;
+    int best_ip = 0;
+    uint64_t best_dist = 1 << 16;
+    for (int i = 0; i < CODEC_STREAMS; i++) {
+        const codec_stream_t *st = &e->state.streams[i];
+        uint64_t dist = st->last > access->addr ? st->last - access->addr : access->addr - st->last;
+        int same_ip = st->ip == access->ip;
+        if (st->op == access->op && dist < (1 << 16) && (same_ip > best_ip || (same_ip == best_ip && dist < best_dist))) {
+            best = i;
+            best_ip = same_ip;
+            best_dist = dist;
+        }
+    }
+    if (best == -1) {
+        best = e->victim;
+        e->victim = (e->victim + 1) % CODEC_STREAMS;
+    }
+
+    t.kind = CodecLiteral;
+    t.stream = best;
+    t.op = access->op;
+    t.size = access->size;
+    t.delta = access->addr - e->state.streams[best].last;
+    t.ip_delta = access->ip - e->state.streams[best].ip;
+    return t;
+}
+
+// Emit the pending repeat, or its tokens if it is too short to pay off
+static inline void encoderFlushMatch(trace_encoder_t *e, vector<uint8_t> &out) {
+    if (e->match_len >= CODEC_MIN_RUN) {
+        out.push_back((uint8_t)(0x80 | (e->match_dist - 1)));
+        codecPutVarint(out, e->match_len);
+    }
+    else {
+        for (uint64_t i = e->match_len; i > 0; i--) {
+            codecPutToken(out, &e->state.history[(e->state.tokens - i) % CODEC_WINDOW]);
+        }
+    }
+    e->match_dist = 0;
+    e->match_len = 0;
+}
+
+// Encode one access, appending any completed records to out
+static inline void encoderPut(trace_encoder_t *e, const trace_access_t *access, vector<uint8_t> &out) {
+    codec_state_t *s = &e->state;
+    codec_token_t t = encoderToken(e, access);
+    trace_access_t decoded;
+
+    // Extend the current repeat
+    if (e->match_dist > 0) {
+        if (codecTokenEqual(&t, &s->history[(s->tokens - e->match_dist) % CODEC_WINDOW])) {
+            e->match_len += 1;
+            codecApply(s, &t, &decoded);
+            return;
+        }
+        encoderFlushMatch(e, out);
+    }
+
+    // Start a repeat at the nearest equal token
+    uint64_t window = s->tokens < CODEC_WINDOW ? s->tokens : CODEC_WINDOW;
+    for (uint64_t k = 1; k <= window; k++) {
+        if (codecTokenEqual(&t, &s->history[(s->tokens - k) % CODEC_WINDOW])) {
+            e->match_dist = k;
+            e->match_len = 1;
+            codecApply(s, &t, &decoded);
+            return;
+        }
+    }
+
+    codecPutToken(out, &t);
+    codecApply(s, &t, &decoded);
+}
+
+// Emit whatever is pending at the end of a stream
+static inline void encoderFinish(trace_encoder_t *e, vector<uint8_t> &out) {
+    if (e->match_dist > 0) {
+        encoderFlushMatch(e, out);
+    }
+}
+
+/* ===================================================================== */
+/* Decoder                                                               */
+/* ===================================================================== */
+
+typedef struct {
+    codec_state_t state;
+    int      repeat_dist;       // Repeat being replayed
+    uint64_t repeat_left;
+    int      ips;               // Literals carry an ip delta (version 5 on)
+} trace_decoder_t;
+
+static inline void decoderInit(trace_decoder_t *d, int ips) {
+    codecInit(&d->state);
+    d->repeat_dist = 0;
+    d->repeat_left = 0;
+    d->ips = ips;
+}
+
+static inline int codecGetVarint(const uint8_t **p, const uint8_t *end, uint64_t *v) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+        uint8_t b = *(*p)++;
+        result |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Decode the next access from [*p, end)
+// Returns 1 for an access, 0 at the end of the input, -1 on bad input. A
+// record is never split unless the input itself is truncated, so callers
+// that feed the input in pieces keep at least CODEC_MAX_TOKEN bytes ahead.
+static inline int decoderNext(trace_decoder_t *d, const uint8_t **p, const uint8_t *end,
+                              trace_access_t *access) {
+    codec_state_t *s = &d->state;
+    codec_token_t t;
+
+    if (d->repeat_left == 0) {
+        if (*p == end) return 0;
+
+        uint8_t b = *(*p)++;
+        uint64_t v;
+
+        if ((b & 0xc0) == 0x80) {
+            d->repeat_dist = (b & 0x3f) + 1;
+            if (codecGetVarint(p, end, &d->repeat_left) == -1 || d->repeat_left == 0 ||
+                (uint64_t)d->repeat_dist > s->tokens) {
+                return -1;
+            }
+        }
+        else {
+            memset(&t, 0, sizeof(t));
+            t.stream = (b >> 3) & 7;
+
+            if ((b & 0xc0) == 0x00) {
+                t.kind = CodecHit;
+                t.icount_delta = b & 7;
+                if (t.icount_delta == 7) {
+                    if (codecGetVarint(p, end, &v) == -1) return -1;
+                    t.icount_delta = v;
+                }
+            }
+            else if ((b & 0xc0) == 0x40) {
+                static const uint16_t sizes[3] = {8, 4, 1};
+                t.kind = CodecLiteral;
+                t.op = (b >> 2) & 1;
+                if ((b & 3) == 3) {
+                    if (codecGetVarint(p, end, &v) == -1) return -1;
+                    t.size = v;
+                }
+                else {
+                    t.size = sizes[b & 3];
+                }
+                if (codecGetVarint(p, end, &v) == -1) return -1;
+                t.delta = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+                if (codecGetVarint(p, end, &v) == -1) return -1;
+                t.icount_delta = v;
+                if (d->ips) {
+                    if (codecGetVarint(p, end, &v) == -1) return -1;
+                    t.ip_delta = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+                }
+            }
+            else {
+                return -1;
+            }
+
+            codecApply(s, &t, access);
+            return 1;
+        }
+    }
+
+    // Next token of the repeat
+    t = s->history[(s->tokens - d->repeat_dist) % CODEC_WINDOW];
+    d->repeat_left -= 1;
+    codecApply(s, &t, access);
+    return 1;
+}
+
+// Encode a whole access list
+inline void encodeAccesses(const trace_access_t *accesses, uint64_t count, vector<uint8_t> &out) {
+    trace_encoder_t e;
+    encoderInit(&e);
+    for (uint64_t i = 0; i < count; i++) {
+        encoderPut(&e, &accesses[i], out);
+    }
+    encoderFinish(&e, out);
+}
+
+#endif
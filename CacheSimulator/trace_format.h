@@ -0,0 +1,97 @@
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+#include <stdint.h>
+#include <string.h>
+
+// On-disk layout of the binary memory trace
+//
+//   [trace_header_t]
+//   [packed data of every thread]
+//   [trace_index_t x num_threads]   <- header.index_offset
+//
+// A thread's data is either an ordered stream of trace_access_t records
+// (program order, as emitted by the Pin tool) or, for traces of the older
+// text format, separate packed read and write addresses (int64_t each).
+// Ordered streams are normally stored encoded (see trace_codec.h): then
+// packed_size bytes of records sit at access_offset. Since version 5 an
+// access also records the address of the accessing instruction, if the
+// thread's index entry has TRACE_FLAG_IP.
+//
+// The index is written last so that converters can stream data out without
+// knowing how much there is up front. All values are stored in host
+// (little-endian) byte order and every array is 8-byte aligned, so the
+// simulator can mmap the file and walk the arrays in place.
+
+#define TRACE_MAGIC        "MASTRACE"
+#define TRACE_MAGIC_LEN    8
+#define TRACE_VERSION      5
+
+// Kinds of ordered accesses
+#define TRACE_OP_READ      0
+#define TRACE_OP_WRITE     1
+
+// Index entry flags
+#define TRACE_FLAG_IP      1          // Accesses carry instruction addresses
+
+typedef struct {
+    char     magic[TRACE_MAGIC_LEN];  // TRACE_MAGIC, not NUL terminated
+    uint32_t version;                 // TRACE_VERSION (1 to 4 are still read)
+    uint32_t num_threads;             // Entries in the index
+    uint64_t index_offset;            // Byte offset of the index
+} trace_header_t;
+
+typedef struct {
+    int64_t  thread_id;               // Pin thread id
+    int64_t  instr_count;             // Instructions executed by the thread
+    uint64_t read_offset;             // Byte offset of packed read addresses
+    uint64_t read_count;              // Number of read addresses
+    uint64_t write_offset;            // Byte offset of packed write addresses
+    uint64_t write_count;             // Number of write addresses
+    uint64_t access_offset;           // Byte offset of ordered accesses (v2)
+    uint64_t access_count;            // Number of ordered accesses (v2)
+    uint64_t packed_size;             // Bytes of encoded accesses, 0 if raw (v3)
+    uint64_t sampled_from;            // Accesses executed when only access_count
+                                      // of them were recorded, 0 if all were (v4)
+    uint64_t flags;                   // TRACE_FLAG_* (v5)
+} trace_index_t;
+
+// Older index entries stop before access_offset (v1), packed_size (v2),
+// sampled_from (v3) or flags (v4)
+#define TRACE_INDEX_V1_SIZE  (6 * sizeof(uint64_t))
+#define TRACE_INDEX_V2_SIZE  (8 * sizeof(uint64_t))
+#define TRACE_INDEX_V3_SIZE  (9 * sizeof(uint64_t))
+#define TRACE_INDEX_V4_SIZE  (10 * sizeof(uint64_t))
+
+typedef struct {
+    int64_t  addr;                    // Address accessed
+    uint32_t icount_delta;            // Instructions since the previous access,
+                                      // including the accessing one
+    uint16_t size;                    // Bytes accessed
+    uint8_t  op;                      // TRACE_OP_READ / TRACE_OP_WRITE
+    uint8_t  pad;
+    uint64_t ip;                      // Accessing instruction, 0 if not recorded (v5)
+} trace_access_t;
+
+// Raw access records before version 5 stop before ip
+#define TRACE_ACCESS_V4_SIZE 16
+
+// Size of one raw access record of a given version
+static inline size_t traceAccessSize(uint32_t version) {
+    return version < 5 ? TRACE_ACCESS_V4_SIZE : sizeof(trace_access_t);
+}
+
+// Size of one index entry of a given version
+static inline size_t traceIndexSize(uint32_t version) {
+    return version == 1 ? TRACE_INDEX_V1_SIZE : version == 2 ? TRACE_INDEX_V2_SIZE :
+           version == 3 ? TRACE_INDEX_V3_SIZE : version == 4 ? TRACE_INDEX_V4_SIZE : sizeof(trace_index_t);
+}
+
+// Copy entry i of a raw index into the current layout
+static inline void traceIndexEntry(const char *index, uint32_t version, uint32_t i, trace_index_t *entry) {
+    size_t size = traceIndexSize(version);
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry, index + i * size, size);
+}
+
+#endif
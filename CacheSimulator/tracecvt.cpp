@@ -0,0 +1,464 @@
+// Convert a Pin text trace into the binary trace format read by the simulator,
+// or (-d) a binary trace back into text, e.g. for schedule.py
+// Ordered access lists are encoded (see trace_codec.h) unless -raw is given.
+// -p writes the per-task profile of a binary trace (see profile.h).
+// --self-test round-trips synthetic access lists through the codec.
+//
+//   gcc -o tracecvt -O2 tracecvt.cpp -lstdc++
+//   ./tracecvt pinatrace_mm.out pinatrace_mm.trace
+//   ./tracecvt -d pinatrace.trace pinatrace_mm.out
+//   ./tracecvt -p pinatrace.trace pinatrace_mm.prof [line size] [window]
+//   ./tracecvt --self-test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "trace.h"
+#include "profile.h"
+using namespace std;
+
+// Buffered writer for packed addresses and access records
+typedef struct {
+    FILE *fptr;
+    uint64_t offset;
+    vector<int64_t> buf;
+    vector<trace_access_t> records;
+    vector<uint8_t> packed;
+    int encode;
+} trace_writer_t;
+
+static int writeBytes(trace_writer_t *w, const void *data, size_t size) {
+    if (fwrite(data, 1, size, w->fptr) != size) {
+        printf("Error writing output trace!\n");
+        return -1;
+    }
+    w->offset += size;
+    return 0;
+}
+
+static int flushAddresses(trace_writer_t *w) {
+    if (w->buf.empty()) return 0;
+    int ret = writeBytes(w, w->buf.data(), w->buf.size() * sizeof(int64_t));
+    w->buf.clear();
+    return ret;
+}
+
+// Stream one address list of the current thread to the output
+static int convertList(text_trace_t *t, trace_writer_t *w, uint64_t *offset, uint64_t *count) {
+    long addr;
+    int ret;
+
+    *offset = w->offset;
+    *count = 0;
+
+    while ((ret = textNextAddress(t, &addr)) == 1) {
+        w->buf.push_back(addr);
+        *count += 1;
+        if (w->buf.size() == w->buf.capacity() && flushAddresses(w) == -1) return -1;
+    }
+
+    if (ret == -1) return -1;
+    return flushAddresses(w);
+}
+
+static int flushRecords(trace_writer_t *w) {
+    if (w->records.empty()) return 0;
+    int ret = writeBytes(w, w->records.data(), w->records.size() * sizeof(trace_access_t));
+    w->records.clear();
+    return ret;
+}
+
+static int flushPacked(trace_writer_t *w) {
+    if (w->packed.empty()) return 0;
+    int ret = writeBytes(w, w->packed.data(), w->packed.size());
+    w->packed.clear();
+    return ret;
+}
+
+// Stream the ordered access list of the current thread to the output,
+// encoded unless w->encode is 0
+static int convertAccesses(text_trace_t *t, trace_writer_t *w, trace_index_t *entry) {
+    trace_access_t access;
+    trace_encoder_t e;
+    int ret;
+
+    entry->access_offset = w->offset;
+    entry->access_count = 0;
+    encoderInit(&e);
+
+    while ((ret = textNextAccess(t, &access)) == 1) {
+        entry->access_count += 1;
+        if (w->encode) {
+            encoderPut(&e, &access, w->packed);
+            if (w->packed.size() >= (1 << 20) && flushPacked(w) == -1) return -1;
+        }
+        else {
+            w->records.push_back(access);
+            if (w->records.size() == w->records.capacity() && flushRecords(w) == -1) return -1;
+        }
+    }
+    if (ret == -1) return -1;
+    if (t->ips && entry->access_count > 0) entry->flags |= TRACE_FLAG_IP;
+
+    if (!w->encode) {
+        return flushRecords(w);
+    }
+
+    encoderFinish(&e, w->packed);
+    if (flushPacked(w) == -1) return -1;
+    entry->packed_size = w->offset - entry->access_offset;
+
+    // Keep the following arrays 8-byte aligned
+    static const uint8_t zeros[8] = {0};
+    return writeBytes(w, zeros, (8 - w->offset % 8) % 8);
+}
+
+static void writeList(FILE *out, const long *list, long count) {
+    fprintf(out, "[");
+    for (long i = 0; i < count; i++) {
+        fprintf(out, i == 0 ? "%ld" : ", %ld", list[i]);
+    }
+    fprintf(out, "]");
+}
+
+// Write a binary trace in the text format
+static int dumpTrace(const char *in, const char *path) {
+    trace_map_t map;
+    vector<threadinfo_t *> threads;
+    if (mapBinaryTrace(in, &map, threads) == -1) {
+        return -1;
+    }
+
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        printf("Error Opening Output File!\n");
+        unmapBinaryTrace(&map);
+        return -1;
+    }
+
+    int failed = 0;
+    for (threadinfo_t *t : threads) {
+        fprintf(out, "(%d, %ld, ", t->thread_id, t->instr_count);
+        if (threadOrdered(t)) {
+            fprintf(out, "[");
+            trace_access_t a;
+            for (long i = 0; threadNextAccess(t, &a); i++) {
+                fprintf(out, "%s(%u, %ld, %u, %u", i == 0 ? "" : ", ",
+                        a.op, (long)a.addr, a.size, a.icount_delta);
+                if (t->has_ip) fprintf(out, ", %lu", (unsigned long)a.ip);
+                fprintf(out, ")");
+            }
+            fprintf(out, "]");
+            failed |= threadFailed(t);
+        }
+        else {
+            writeList(out, t->read_list, t->read_count);
+            fprintf(out, ", ");
+            writeList(out, t->write_list, t->write_count);
+        }
+        fprintf(out, ")\n");
+        deleteThread(t);
+    }
+    fprintf(out, "#eof\n");
+
+    int ret = fclose(out) == 0 ? 0 : -1;
+    if (ret == -1) {
+        printf("Error writing output trace!\n");
+    }
+    unmapBinaryTrace(&map);
+    return failed ? -1 : ret;
+}
+
+// Write the task profiles of a binary trace
+static int profileTrace(const char *in, const char *path, int line_size, long window) {
+    trace_map_t map;
+    vector<threadinfo_t *> threads;
+    if (mapBinaryTrace(in, &map, threads) == -1) {
+        return -1;
+    }
+
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        printf("Error Opening Output File!\n");
+        unmapBinaryTrace(&map);
+        return -1;
+    }
+
+    profileWriteHeader(out, line_size, window);
+    task_profile_t *p = new task_profile_t;
+    int failed = 0;
+    for (threadinfo_t *t : threads) {
+        profileInit(p, line_size, window);
+        if (threadOrdered(t)) {
+            trace_access_t a;
+            while (threadNextAccess(t, &a)) profileAccess(p, a.addr, a.size);
+            failed |= threadFailed(t);
+        }
+        else {
+            // Older traces only keep addresses, reads before writes
+            for (long i = 0; i < t->read_count; i++) profileAccess(p, t->read_list[i], 1);
+            for (long i = 0; i < t->write_count; i++) profileAccess(p, t->write_list[i], 1);
+        }
+        profileWrite(out, t->thread_id, t->instr_count, p);
+        deleteThread(t);
+    }
+    delete p;
+
+    int ret = fclose(out) == 0 ? 0 : -1;
+    if (ret == -1) {
+        printf("Error writing profile!\n");
+    }
+    unmapBinaryTrace(&map);
+    return failed ? -1 : ret;
+}
+
+/* ===================================================================== */
+/* Codec self-test                                                       */
+/* ===================================================================== */
+
+static uint64_t testRandom(uint64_t *seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return *seed;
+}
+
+static void testPut(vector<trace_access_t> &list, int op, int64_t addr, uint16_t size, uint32_t icount_delta,
+                    uint64_t ip) {
+    trace_access_t a;
+    memset(&a, 0, sizeof(a));
+    a.op = op;
+    a.addr = addr;
+    a.size = size;
+    a.icount_delta = icount_delta;
+    a.ip = ip;
+    list.push_back(a);
+}
+
+// Encode list and decode it back, from a mapping as the simulator does
+static int testRoundTrip(const char *name, const vector<trace_access_t> &list) {
+    vector<uint8_t> packed;
+    encodeAccesses(list.data(), list.size(), packed);
+
+    threadinfo_t t = threadinfo_t();
+    t.access_stream = newMappedStream(packed.data(), list.size(), packed.size(), TRACE_VERSION);
+
+    size_t n = 0;
+    trace_access_t a;
+    int ok = 1;
+    while (ok && n < list.size() && threadNextAccess(&t, &a)) {
+        const trace_access_t &e = list[n];
+        ok = a.op == e.op && a.addr == e.addr && a.size == e.size &&
+             a.icount_delta == e.icount_delta && a.ip == e.ip;
+        if (!ok) {
+            printf("Self-test %s: access %zu decoded as (%u, %ld, %u, %u, %lx), expected (%u, %ld, %u, %u, %lx)\n",
+                   name, n, a.op, (long)a.addr, a.size, a.icount_delta, (unsigned long)a.ip,
+                   e.op, (long)e.addr, e.size, e.icount_delta, (unsigned long)e.ip);
+        }
+        n++;
+    }
+
+    // Nothing may follow the last access
+    trace_stream_t *s = t.access_stream;
+    const uint8_t *p = s->data + s->offset;
+    if (ok && (threadFailed(&t) || n != list.size() || decoderNext(s->decoder, &p, s->data_end, &a) != 0)) {
+        printf("Self-test %s: decoded %zu of %zu accesses\n", name, n, list.size());
+        ok = 0;
+    }
+
+    threadRelease(&t);
+    delete s->decoder;
+    delete s->mark;
+    delete s;
+    if (ok) {
+        printf("Self-test %s: %zu accesses in %zu bytes\n", name, list.size(), packed.size());
+    }
+    return ok ? 0 : -1;
+}
+
+// Round-trip lists that exercise every token kind and field width
+static int selfTest() {
+    vector<trace_access_t> list;
+    int failed = 0;
+
+    // Loop bodies of up to twice CODEC_WINDOW distinct tokens (hits on five
+    // strided streams), repeated: the repeats reach back to either side of
+    // the window edge
+    for (int body = 1; body <= 2 * CODEC_WINDOW + 1; body += 7) {
+        list.clear();
+        int64_t next[5] = {0};
+        for (int iter = 0; iter < 50; iter++) {
+            for (int i = 0; i < body; i++) {
+                int k = i % 5;
+                testPut(list, TRACE_OP_READ, 0x10000000L * (k + 1) + 8 * next[k]++, 8, i, 0x401000 + 4 * i);
+            }
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "loop-%d", body);
+        failed |= testRoundTrip(name, list);
+    }
+
+    // Repeats much longer than the window
+    list.clear();
+    for (int i = 0; i < 100000; i++) {
+        testPut(list, TRACE_OP_READ, 0x40000000L + 4 * i, 4, 1, 0x401100);
+        testPut(list, TRACE_OP_WRITE, 0x50000000L + 4 * i, 4, 1, 0x401104);
+    }
+    failed |= testRoundTrip("long-repeat", list);
+
+    // Negative strides and deltas (addresses and instructions), near and far
+    list.clear();
+    for (int i = 0; i < 20000; i++) {
+        testPut(list, TRACE_OP_READ, 0x7fff0000L - 64 * i, 8, 3, 0x7f0000402000UL);
+        testPut(list, TRACE_OP_READ, 0x7fff0000L - (1L << 40) + (i % 5 == 0 ? -4096L * i : 24L * i), 8, 0,
+                i % 7 == 0 ? 0x401000 : 0x7f0000401ff0UL);
+    }
+    failed |= testRoundTrip("negative", list);
+
+    // Every size code, including the varint sizes up to 2^16 - 1 (and no
+    // instruction addresses)
+    static const uint16_t sizes[] = {1, 2, 3, 4, 8, 16, 64, 16383, 16384, 40000, 65535};
+    list.clear();
+    for (int i = 0; i < 10000; i++) {
+        testPut(list, i & 1, 0x1000L * (i % 97), sizes[i % (sizeof(sizes) / sizeof(sizes[0]))], 5, 0);
+    }
+    failed |= testRoundTrip("sizes", list);
+
+    // icount_delta around the inline limit (7) and up to 2^32 - 1
+    static const uint32_t deltas[] = {0, 1, 6, 7, 8, 127, 128, 16384, 1u << 31, UINT32_MAX};
+    list.clear();
+    for (int i = 0; i < 10000; i++) {
+        testPut(list, TRACE_OP_READ, 0x2000L + 8 * i, 8, deltas[i % (sizeof(deltas) / sizeof(deltas[0]))],
+                0x400000 + 8 * (i % 3));
+    }
+    failed |= testRoundTrip("icount", list);
+
+    // Everything mixed at random
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    list.clear();
+    for (int i = 0; i < 200000; i++) {
+        uint64_t r = testRandom(&seed);
+        int64_t addr = (int64_t)(testRandom(&seed) >> (r % 40 + 16)) - (1L << 20);
+        testPut(list, r & 1, r & 2 ? addr : 0x8000L + 8 * (i % 300),
+                sizes[(r >> 8) % (sizeof(sizes) / sizeof(sizes[0]))],
+                r & 4 ? (uint32_t)(r >> 32) >> ((r >> 16) % 32) : (r >> 24) % 8,
+                r & 8 ? testRandom(&seed) : 0x400000 + 4 * ((r >> 40) % 64));
+    }
+    failed |= testRoundTrip("random", list);
+
+    printf(failed ? "Self-test failed\n" : "Self-test passed\n");
+    return failed ? -1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc == 2 && strcmp(argv[1], "--self-test") == 0) {
+        return selfTest();
+    }
+
+    if (argc == 4 && strcmp(argv[1], "-d") == 0) {
+        return dumpTrace(argv[2], argv[3]);
+    }
+
+    if (argc >= 4 && argc <= 6 && strcmp(argv[1], "-p") == 0) {
+        int line_size = argc > 4 ? atoi(argv[4]) : 64;
+        long window = argc > 5 ? atol(argv[5]) : 4096;
+        if (line_size <= 0 || (line_size & (line_size - 1)) != 0 || window <= 0) {
+            printf("Line size must be a power of two and window positive\n");
+            return -1;
+        }
+        return profileTrace(argv[2], argv[3], line_size, window);
+    }
+
+    int encode = 1;
+    if (argc == 4 && strcmp(argv[1], "-raw") == 0) {
+        encode = 0;
+        argc--;
+        argv++;
+    }
+
+    if (argc != 3) {
+        printf("Usage: %s [-raw] <text trace> <binary trace>\n", argv[0]);
+        printf("       %s -d <binary trace> <text trace>\n", argv[0]);
+        printf("       %s -p <binary trace> <profile> [line size] [window]\n", argv[0]);
+        printf("       %s --self-test\n", argv[0]);
+        return -1;
+    }
+
+    text_trace_t t;
+    t.fptr = fopen(argv[1], "r");
+    if (t.fptr == NULL) {
+        printf("Error Opening Trace File!\n");
+        return -1;
+    }
+
+    trace_writer_t w;
+    w.fptr = fopen(argv[2], "wb");
+    w.offset = 0;
+    w.buf.reserve(1 << 16);
+    w.records.reserve(1 << 15);
+    w.encode = encode;
+    if (w.fptr == NULL) {
+        printf("Error Opening Output File!\n");
+        fclose(t.fptr);
+        return -1;
+    }
+
+    // Placeholder header, rewritten once the index location is known
+    trace_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, TRACE_MAGIC_LEN);
+    header.version = TRACE_VERSION;
+    if (writeBytes(&w, &header, sizeof(header)) == -1) return -1;
+
+    vector<trace_index_t> index;
+    long thread_id, instr_count;
+    int ret;
+
+    while ((ret = textNextThread(&t, &thread_id, &instr_count)) == 1) {
+        trace_index_t entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.thread_id = thread_id;
+        entry.instr_count = instr_count;
+
+        int ok;
+        if (textOrderedList(&t)) {
+            ok = convertAccesses(&t, &w, &entry) == 0;
+        }
+        else {
+            int next;
+            ok = convertList(&t, &w, &entry.read_offset, &entry.read_count) == 0 &&
+                 (next = textNextList(&t)) != -1 &&
+                 (next == 1 || convertList(&t, &w, &entry.write_offset, &entry.write_count) == 0);
+        }
+
+        if (!ok || textEndThread(&t) == -1) {
+            printf("Malformed trace entry for thread %ld\n", thread_id);
+            return -1;
+        }
+
+        index.push_back(entry);
+    }
+
+    if (ret == -1) {
+        printf("Malformed trace file!\n");
+        return -1;
+    }
+
+    // Write index and patch header
+    header.num_threads = index.size();
+    header.index_offset = w.offset;
+    if (writeBytes(&w, index.data(), index.size() * sizeof(trace_index_t)) == -1) return -1;
+
+    if (fseek(w.fptr, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(header), 1, w.fptr) != 1 ||
+        fclose(w.fptr) != 0) {
+        printf("Error writing output trace!\n");
+        return -1;
+    }
+    fclose(t.fptr);
+
+    printf("Converted %u threads (%lu bytes)\n", header.num_threads, (unsigned long)w.offset);
+    return 0;
+}
@@ -5,149 +5,624 @@
 
 /*
  *  This file contains an ISA-portable PIN tool for tracing memory accesses.
+ *
+ *  Every thread's accesses are recorded in program order as
+ *  (op, addr, size, icount_delta, ip): op is 0 for a read and 1 for a
+ *  write, size is in bytes, icount_delta is the number of instructions
+ *  executed since the previous access of the thread, including the
+ *  accessing instruction (0 for further operands of the same instruction),
+ *  and ip is the address of the accessing instruction.
+ *
+ *  Accesses are written inline into fixed-size per-thread buffers (Pin's
+ *  trace buffer API), so the hot path takes no lock and calls no analysis
+ *  routine. Full buffers are handed to an internal writer thread, which
+ *  appends them to one binary trace file per thread while the application
+ *  keeps running. At exit the per-thread files are merged into one indexed
+ *  trace (-o), or kept as they are with -split.
+ *
+ *  The binary layout is the one of the simulator's trace_format.h. The
+ *  writer encodes each thread's accesses as it goes (trace_codec.h, off by
+ *  -compress 0), so strided loops cost a few bytes per iteration on disk.
+ *  Use tracecvt -d to turn it into the text format read by schedule.py.
+ *
+ *  With -profile the writer also builds each thread's cache line profile
+ *  (footprint, reuse distance histogram and working set, see profile.h),
+ *  which is all the schedulers need; -trace 0 then skips the trace itself.
+ *
+ *  Long runs can be sampled: -region only instruments the named function,
+ *  -skip / -length limit recording to a window of each thread's
+ *  instructions and -sample / -period record bursts of -sample out of every
+ *  -period instructions. Sampled threads also count the accesses they
+ *  execute, which the index keeps (sampled_from) so that the simulator can
+ *  extrapolate its statistics.
+ *
+ *  icount_delta is 32 bits wide. A longer gap between two recorded accesses
+ *  (e.g. the first access after a -skip or a -period of more than 2^32
+ *  instructions) is recorded as 2^32 - 1, with a warning once per thread.
+ *  Filler records would add accesses that never happened; the thread's
+ *  instruction count in the index stays exact either way.
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <string>
 #include <vector>
-#include <tuple>
+#include <deque>
 #include "pin.H"
+#include "../CacheSimulator/trace_codec.h" // binary trace layout and encoder
+#include "../CacheSimulator/profile.h"
 using namespace std;
 
-FILE* trace;
-PIN_LOCK globalLock;
+/* ===================================================================== */
+/* Knobs                                                                 */
+/* ===================================================================== */
 
-// Force each thread's data to be in its own data cache line so that
-// multiple threads do not contend for the same data cache line.
-// This avoids the false sharing problem.
-#define PADSIZE 40 // 64 byte line size: 64-8
+KNOB< string > KnobOutput(KNOB_MODE_WRITEONCE, "pintool", "o", "pinatrace.trace", "output trace file");
+KNOB< BOOL > KnobSplit(KNOB_MODE_WRITEONCE, "pintool", "split", "0",
+                       "keep one trace file per thread (<o>.<tid>) instead of merging them into <o>");
+KNOB< UINT32 > KnobPages(KNOB_MODE_WRITEONCE, "pintool", "pages", "256", "pages per thread buffer");
+KNOB< UINT32 > KnobSpare(KNOB_MODE_WRITEONCE, "pintool", "spare", "16",
+                         "buffers in flight to the writer before application threads wait");
+KNOB< BOOL > KnobCompress(KNOB_MODE_WRITEONCE, "pintool", "compress", "1",
+                          "encode the accesses (0 writes raw trace_access_t records)");
+KNOB< BOOL > KnobTrace(KNOB_MODE_WRITEONCE, "pintool", "trace", "1", "write the trace (-o)");
+KNOB< string > KnobProfile(KNOB_MODE_WRITEONCE, "pintool", "profile", "", "write per-thread cache line profiles to this file");
+KNOB< UINT32 > KnobLine(KNOB_MODE_WRITEONCE, "pintool", "line", "64", "cache line size of the profiles");
+KNOB< UINT32 > KnobWindow(KNOB_MODE_WRITEONCE, "pintool", "window", "4096", "accesses per working set window of the profiles");
+KNOB< string > KnobRegion(KNOB_MODE_WRITEONCE, "pintool", "region", "", "only record accesses of this function, e.g. matrixParallel");
+KNOB< UINT64 > KnobSkip(KNOB_MODE_WRITEONCE, "pintool", "skip", "0", "instructions of each thread before recording starts");
+KNOB< UINT64 > KnobLength(KNOB_MODE_WRITEONCE, "pintool", "length", "0", "instructions of each thread recorded after -skip, 0 for all");
+KNOB< UINT64 > KnobSample(KNOB_MODE_WRITEONCE, "pintool", "sample", "0", "instructions recorded at the start of every -period");
+KNOB< UINT64 > KnobPeriod(KNOB_MODE_WRITEONCE, "pintool", "period", "0", "sampling period in instructions, 0 records every access");
 
-typedef vector<unsigned long> memory_access_t;
+/* ===================================================================== */
+/* Buffers                                                               */
+/* ===================================================================== */
 
-// a running count of the instructions
-class thread_data_t
+// Record filled inline by the instrumentation. Fields written from
+// IARG_UINT32 are 4 bytes wide. The instruction count of the access is
+// count - back: count is the thread's count once its block has started and
+// back the number of instructions of the block after the accessing one.
+typedef struct
+{
+    ADDRINT addr;
+    ADDRINT ip;
+    ADDRINT count;
+    UINT32 back;
+    UINT32 size;
+    UINT32 op;
+    UINT32 pad;
+} buffer_record_t;
+
+// Full buffer waiting for the writer
+typedef struct
+{
+    THREADID tid;
+    buffer_record_t* records;
+    UINT64 count;
+} full_buffer_t;
+
+// Per-thread output, only touched by the writer thread (and by Fini once
+// the writer has stopped)
+typedef struct
 {
-  public:
-    thread_data_t() : _count(0) {}
-    UINT64 _count;
-    memory_access_t read_mem_log;
-    memory_access_t write_mem_log;
-    UINT8 _pad[PADSIZE];
-};
+    FILE* fptr;
+    UINT64 last_icount;   // instruction count at the previous access
+    UINT64 accesses;      // records written
+    UINT64 bytes;         // bytes of access data written
+    trace_encoder_t encoder;
+    task_profile_t* profile; // with -profile
+    bool used;
+    bool clamped;         // an icount_delta was clamped (warned once)
+} thread_file_t;
+
+static BUFFER_ID bufId;
+static REG countReg;       // per-thread instruction count (tool register)
+static REG memReg;         // per-thread executed accesses, when sampling
+static BOOL sampling;      // recording limited by -skip / -length / -period
+static UINT64 skipCount, lengthCount, sampleCount, periodCount; // knob values, read by ShouldRecord
+
+static PIN_LOCK queueLock; // full / free buffer lists
+static deque< full_buffer_t > fullBuffers;
+static vector< VOID* > freeBuffers;
+static UINT32 spareBuffers = 0;
+static PIN_SEMAPHORE fullSem;
+static PIN_SEMAPHORE freeSem;
+static volatile BOOL stopping = FALSE;
+static PIN_THREAD_UID writerUid;
+
+static PIN_LOCK countLock; // final instruction counts, taken once per thread
+static vector< UINT64 > instrCounts;
+static vector< UINT64 > memCounts;
+
+static vector< thread_file_t > files;
+
+static string ThreadPath(THREADID tid)
+{
+    return KnobOutput.Value() + "." + decstr(tid);
+}
 
-// key for accessing TLS storage in the threads. initialized once in main()
-static TLS_KEY tls_key = INVALID_TLS_KEY;
+/* ===================================================================== */
+/* Writer thread                                                         */
+/* ===================================================================== */
 
-// This function is called before every block
-VOID PIN_FAST_ANALYSIS_CALL docount(UINT32 c, THREADID threadid)
+static BOOL WriteHeader(FILE* fptr, UINT32 num_threads, UINT64 index_offset)
 {
-    thread_data_t* tdata = static_cast< thread_data_t* >(PIN_GetThreadData(tls_key, threadid));
-    tdata->_count += c;
+    trace_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, TRACE_MAGIC_LEN);
+    header.version = TRACE_VERSION;
+    header.num_threads = num_threads;
+    header.index_offset = index_offset;
+    return fwrite(&header, sizeof(header), 1, fptr) == 1;
 }
 
-VOID ThreadStart(THREADID threadid, CONTEXT* ctxt, INT32 flags, VOID* v)
+// Append access data to a thread's file
+static BOOL WriteData(thread_file_t& f, const VOID* data, UINT64 size)
 {
-    thread_data_t* tdata = new thread_data_t;
-    if (PIN_SetThreadData(tls_key, tdata, threadid) == FALSE)
+    if (fwrite(data, 1, size, f.fptr) != size) return FALSE;
+    f.bytes += size;
+    return TRUE;
+}
+
+// A thread file could not be written (e.g. the disk is full): stop rather
+// than leave a trace with silently missing accesses
+static VOID WriteFailed(THREADID tid)
+{
+    fprintf(stderr, "pinatrace: cannot write %s\n", ThreadPath(tid).c_str());
+    PIN_ExitProcess(1);
+}
+
+// Convert a full buffer into trace records and append it to its thread's file
+static VOID WriteBuffer(const full_buffer_t& full, vector< trace_access_t >& out, vector< UINT8 >& packed)
+{
+    if (files.size() <= full.tid) files.resize(full.tid + 1);
+    thread_file_t& f = files[full.tid];
+
+    if (!f.used && !KnobProfile.Value().empty())
     {
-        printf("PIN_SetThreadData failed\n");
-        PIN_ExitProcess(1);
+        f.profile = new task_profile_t;
+        profileInit(f.profile, KnobLine.Value(), KnobWindow.Value());
     }
+    if (!f.used && KnobTrace)
+    {
+        f.fptr = fopen(ThreadPath(full.tid).c_str(), "wb");
+        if (f.fptr == NULL)
+        {
+            fprintf(stderr, "pinatrace: cannot open %s\n", ThreadPath(full.tid).c_str());
+            PIN_ExitProcess(1);
+        }
+        // Header patched once the thread is complete
+        if (!WriteHeader(f.fptr, 0, 0)) WriteFailed(full.tid);
+        encoderInit(&f.encoder);
+    }
+    f.used = true;
+
+    out.resize(full.count);
+    for (UINT64 i = 0; i < full.count; i++)
+    {
+        const buffer_record_t& r = full.records[i];
+        UINT64 icount = r.count - r.back;
+
+        UINT64 delta = icount - f.last_icount;
+        if (delta > UINT32_MAX)
+        {
+            if (!f.clamped)
+            {
+                fprintf(stderr, "pinatrace: thread %u: %llu instructions between two accesses, recorded as %u\n",
+                        (unsigned)full.tid, (unsigned long long)delta, (unsigned)UINT32_MAX);
+                f.clamped = true;
+            }
+            delta = UINT32_MAX;
+        }
+
+        out[i].addr = r.addr;
+        out[i].icount_delta = delta;
+        out[i].size = r.size;
+        out[i].op = r.op;
+        out[i].pad = 0;
+        out[i].ip = r.ip;
+        f.last_icount = icount;
+    }
+    f.accesses += full.count;
+
+    if (f.profile != NULL)
+    {
+        for (UINT64 i = 0; i < full.count; i++)
+        {
+            profileAccess(f.profile, out[i].addr, out[i].size);
+        }
+    }
+
+    if (!KnobTrace) return;
+    if (!KnobCompress)
+    {
+        if (!WriteData(f, out.data(), full.count * sizeof(trace_access_t))) WriteFailed(full.tid);
+        return;
+    }
+
+    packed.clear();
+    for (UINT64 i = 0; i < full.count; i++)
+    {
+        encoderPut(&f.encoder, &out[i], packed);
+    }
+    if (!WriteData(f, packed.data(), packed.size())) WriteFailed(full.tid);
 }
 
-// Pin calls this function every time a new basic block is encountered.
-// It inserts a call to docount.
-VOID Trace(TRACE trace, VOID* v)
+static VOID WriterThread(VOID* arg)
 {
-    // Visit every basic block  in the trace
-    for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl))
+    vector< trace_access_t > out;
+    vector< UINT8 > packed;
+
+    while (1)
     {
-        // Insert a call to docount for every bbl, passing the number of instructions.
-        BBL_InsertCall(bbl, IPOINT_ANYWHERE, (AFUNPTR)docount, IARG_FAST_ANALYSIS_CALL, IARG_UINT32, BBL_NumIns(bbl),
-                       IARG_THREAD_ID, IARG_END);
+        PIN_SemaphoreWait(&fullSem);
+
+        PIN_GetLock(&queueLock, PIN_ThreadId() + 1);
+        if (fullBuffers.empty())
+        {
+            PIN_SemaphoreClear(&fullSem);
+            BOOL done = stopping;
+            PIN_ReleaseLock(&queueLock);
+            if (done) break;
+            continue;
+        }
+        full_buffer_t full = fullBuffers.front();
+        fullBuffers.pop_front();
+        PIN_ReleaseLock(&queueLock);
+
+        WriteBuffer(full, out, packed);
+
+        PIN_GetLock(&queueLock, PIN_ThreadId() + 1);
+        freeBuffers.push_back(full.records);
+        PIN_ReleaseLock(&queueLock);
+        PIN_SemaphoreSet(&freeSem);
     }
 }
 
-// This function is called when the thread exits
-VOID ThreadFini(THREADID threadIndex, const CONTEXT* ctxt, INT32 code, VOID* v)
+/* ===================================================================== */
+/* Application threads                                                   */
+/* ===================================================================== */
+
+// Called by Pin when a thread's buffer is full (and when the thread exits)
+// Hands the buffer to the writer and continues with a free one, waiting
+// only if every spare buffer is still in flight.
+VOID* BufferFull(BUFFER_ID id, THREADID tid, const CONTEXT* ctxt, VOID* buf, UINT64 numElements, VOID* v)
 {
-    thread_data_t* tdata = static_cast< thread_data_t* >(PIN_GetThreadData(tls_key, threadIndex));
-    PIN_GetLock(&globalLock, threadIndex);
+    full_buffer_t full;
+    full.tid = tid;
+    full.records = static_cast< buffer_record_t* >(buf);
+    full.count = numElements;
 
-    fprintf(trace, "(%d, %lu, [", threadIndex, tdata->_count);
+    PIN_GetLock(&queueLock, tid + 1);
+    fullBuffers.push_back(full);
+    PIN_ReleaseLock(&queueLock);
+    PIN_SemaphoreSet(&fullSem);
 
-    // Print read list
-    // returns length of vector as unsigned int
-    unsigned int vecSize = tdata->read_mem_log.size();
-    if (vecSize != 0) {
-        fprintf(trace, "%lu", tdata->read_mem_log[0]);
-    }
-    // run for loop from 0 to vector size
-    for(unsigned int i = 0; i < vecSize; i++) {
-        fprintf(trace, ", %lu", tdata->read_mem_log[i]);
+    while (1)
+    {
+        PIN_GetLock(&queueLock, tid + 1);
+        if (!freeBuffers.empty())
+        {
+            VOID* next = freeBuffers.back();
+            freeBuffers.pop_back();
+            PIN_ReleaseLock(&queueLock);
+            return next;
+        }
+        // Past PrepareForFini nothing frees buffers any more (Fini writes
+        // the last ones), so threads flushed at exit never wait
+        if (spareBuffers < KnobSpare.Value() || stopping)
+        {
+            spareBuffers++;
+            PIN_ReleaseLock(&queueLock);
+            return PIN_AllocateBuffer(id);
+        }
+        PIN_SemaphoreClear(&freeSem);
+        PIN_ReleaseLock(&queueLock);
+        PIN_SemaphoreWait(&freeSem);
     }
-    fprintf(trace, "], [");
+}
 
-    // Print write list
-    // returns length of vector as unsigned int
-    vecSize = tdata->write_mem_log.size();
-    if (vecSize != 0) {
-        fprintf(trace, "%lu", tdata->write_mem_log[0]);
-    }
-    // run for loop from 0 to vector size
-    for(unsigned int i = 0; i < vecSize; i++) {
-        fprintf(trace, ", %lu", tdata->write_mem_log[i]);
-    }
-    fprintf(trace, "])\n");
+// Advance the instruction count at the start of a block
+ADDRINT PIN_FAST_ANALYSIS_CALL AddCount(ADDRINT count, UINT32 c) { return count + c; }
 
-    PIN_ReleaseLock(&globalLock);
+VOID ThreadStart(THREADID threadid, CONTEXT* ctxt, INT32 flags, VOID* v)
+{
+    PIN_SetContextReg(ctxt, countReg, 0);
+    PIN_SetContextReg(ctxt, memReg, 0);
+}
 
-    delete tdata;
+// This function is called when the thread exits
+VOID ThreadFini(THREADID threadIndex, const CONTEXT* ctxt, INT32 code, VOID* v)
+{
+    UINT64 count = PIN_GetContextReg(ctxt, countReg);
+    UINT64 accesses = PIN_GetContextReg(ctxt, memReg);
+
+    PIN_GetLock(&countLock, threadIndex + 1);
+    if (instrCounts.size() <= threadIndex) instrCounts.resize(threadIndex + 1, 0);
+    instrCounts[threadIndex] = count;
+    if (memCounts.size() <= threadIndex) memCounts.resize(threadIndex + 1, 0);
+    memCounts[threadIndex] = accesses;
+    PIN_ReleaseLock(&countLock);
 }
-// Print a memory read record
-VOID RecordMemRead(THREADID threadId, VOID* ip, VOID* addr) {
-    thread_data_t* tdata = static_cast< thread_data_t* >(PIN_GetThreadData(tls_key, threadId));
-    tdata->read_mem_log.push_back((unsigned long)addr);
+
+// Whether the access of an instruction followed by back more in its block
+// falls in the recorded window and in a sampled burst
+ADDRINT PIN_FAST_ANALYSIS_CALL ShouldRecord(ADDRINT count, UINT32 back)
+{
+    UINT64 icount = count - back;
+    if (icount < skipCount) return 0;
+    icount -= skipCount;
+    if (lengthCount && icount >= lengthCount) return 0;
+    return periodCount == 0 || icount % periodCount < sampleCount;
 }
 
-// Print a memory write record
-VOID RecordMemWrite(THREADID threadId, VOID* ip, VOID* addr) {
-    thread_data_t* tdata = static_cast< thread_data_t* >(PIN_GetThreadData(tls_key, threadId));
-    tdata->write_mem_log.push_back((unsigned long)addr);
+// Fill one buffer record for a memory operand
+static VOID InsertRecord(INS ins, UINT32 memOp, UINT32 op, UINT32 back)
+{
+    if (!sampling)
+    {
+        INS_InsertFillBufferPredicated(ins, IPOINT_BEFORE, bufId,
+                                       IARG_MEMORYOP_EA, memOp, offsetof(buffer_record_t, addr),
+                                       IARG_INST_PTR, offsetof(buffer_record_t, ip),
+                                       IARG_REG_VALUE, countReg, offsetof(buffer_record_t, count),
+                                       IARG_UINT32, back, offsetof(buffer_record_t, back),
+                                       IARG_UINT32, INS_MemoryOperandSize(ins, memOp), offsetof(buffer_record_t, size),
+                                       IARG_UINT32, op, offsetof(buffer_record_t, op),
+                                       IARG_END);
+        return;
+    }
+
+    // Same fill behind an inlinable check
+    INS_InsertIfPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR)ShouldRecord, IARG_FAST_ANALYSIS_CALL,
+                               IARG_REG_VALUE, countReg, IARG_UINT32, back, IARG_END);
+    INS_InsertFillBufferThen(ins, IPOINT_BEFORE, bufId,
+                             IARG_MEMORYOP_EA, memOp, offsetof(buffer_record_t, addr),
+                             IARG_INST_PTR, offsetof(buffer_record_t, ip),
+                             IARG_REG_VALUE, countReg, offsetof(buffer_record_t, count),
+                             IARG_UINT32, back, offsetof(buffer_record_t, back),
+                             IARG_UINT32, INS_MemoryOperandSize(ins, memOp), offsetof(buffer_record_t, size),
+                             IARG_UINT32, op, offsetof(buffer_record_t, op),
+                             IARG_END);
 }
 
-// Is called for every instruction and instruments reads and writes
-VOID Instruction(INS ins, VOID* v)
+// Instruments the reads and writes of an instruction followed by back more
+// instructions in its block, returns the number of accesses instrumented
+UINT32 InstrumentMemory(INS ins, UINT32 back)
 {
-    // Instruments memory accesses using a predicated call, i.e.
-    // the instrumentation is called iff the instruction will actually be executed.
+    // Instruments memory accesses using a predicated fill, i.e.
+    // the record is written iff the instruction will actually be executed.
     //
     // On the IA-32 and Intel(R) 64 architectures conditional moves and REP
     // prefixed instructions appear as predicated instructions in Pin.
     UINT32 memOperands = INS_MemoryOperandCount(ins);
+    UINT32 accesses = 0;
 
     // Iterate over each memory operand of the instruction.
     for (UINT32 memOp = 0; memOp < memOperands; memOp++)
     {
         if (INS_MemoryOperandIsRead(ins, memOp))
         {
-            INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR)RecordMemRead, IARG_THREAD_ID, IARG_INST_PTR, IARG_MEMORYOP_EA, memOp,
-                                     IARG_END);
+            InsertRecord(ins, memOp, TRACE_OP_READ, back);
+            accesses++;
         }
         // Note that in some architectures a single memory operand can be
         // both read and written (for instance incl (%eax) on IA-32)
         // In that case we instrument it once for read and once for write.
         if (INS_MemoryOperandIsWritten(ins, memOp))
         {
-            INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR)RecordMemWrite, IARG_THREAD_ID, IARG_INST_PTR, IARG_MEMORYOP_EA, memOp,
-                                     IARG_END);
+            InsertRecord(ins, memOp, TRACE_OP_WRITE, back);
+            accesses++;
         }
     }
+    return accesses;
+}
+
+// Pin calls this function every time a new basic block is encountered.
+// It advances the instruction count and instruments the block's accesses.
+VOID Trace(TRACE trace, VOID* v)
+{
+    // Every instruction is counted, accesses only within -region
+    RTN rtn = TRACE_Rtn(trace);
+    BOOL inRegion = KnobRegion.Value().empty() || (RTN_Valid(rtn) && RTN_Name(rtn) == KnobRegion.Value());
+
+    // Visit every basic block  in the trace
+    for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl))
+    {
+        // Add the number of instructions of the block before any of them runs
+        UINT32 size = BBL_NumIns(bbl);
+        BBL_InsertCall(bbl, IPOINT_BEFORE, (AFUNPTR)AddCount, IARG_CALL_ORDER, CALL_ORDER_FIRST, IARG_FAST_ANALYSIS_CALL,
+                       IARG_REG_VALUE, countReg, IARG_UINT32, size, IARG_RETURN_REGS, countReg, IARG_END);
+
+        if (!inRegion) continue;
+
+        UINT32 n = 1;
+        UINT32 accesses = 0;
+        for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins), n++)
+        {
+            accesses += InstrumentMemory(ins, size - n);
+        }
+
+        // Count the accesses executed, recorded or not, to extrapolate from
+        if (sampling && accesses > 0)
+        {
+            BBL_InsertCall(bbl, IPOINT_BEFORE, (AFUNPTR)AddCount, IARG_FAST_ANALYSIS_CALL, IARG_REG_VALUE, memReg,
+                           IARG_UINT32, accesses, IARG_RETURN_REGS, memReg, IARG_END);
+        }
+    }
+}
+
+/* ===================================================================== */
+/* Exit                                                                  */
+/* ===================================================================== */
+
+// Drain the writer before Pin tears the internal threads down
+VOID PrepareForFini(VOID* v)
+{
+    PIN_GetLock(&queueLock, PIN_ThreadId() + 1);
+    stopping = TRUE;
+    PIN_ReleaseLock(&queueLock);
+    PIN_SemaphoreSet(&fullSem);
+    PIN_WaitForThreadTermination(writerUid, PIN_INFINITE_TIMEOUT, NULL);
+}
+
+// Bytes of a thread's access data including the padding after it
+static UINT64 PaddedBytes(THREADID tid)
+{
+    return (files[tid].bytes + 7) & ~(UINT64)7;
+}
+
+// Instructions executed by a thread
+static UINT64 InstrCount(THREADID tid)
+{
+    return tid < instrCounts.size() && instrCounts[tid] ? instrCounts[tid] : files[tid].last_icount;
+}
+
+// Index entry of a completed thread file whose accesses start at offset
+static trace_index_t ThreadEntry(THREADID tid, UINT64 offset)
+{
+    trace_index_t entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.thread_id = tid;
+    entry.instr_count = InstrCount(tid);
+    entry.read_offset = entry.write_offset = entry.access_offset = offset;
+    entry.access_count = files[tid].accesses;
+    entry.packed_size = KnobCompress ? files[tid].bytes : 0;
+    entry.flags = TRACE_FLAG_IP;
+    if (sampling && tid < memCounts.size() && memCounts[tid] > entry.access_count)
+    {
+        entry.sampled_from = memCounts[tid];
+    }
+    return entry;
+}
+
+// Append the accesses of a thread file to the merged trace
+static BOOL CopyAccesses(THREADID tid, FILE* out)
+{
+    FILE* in = fopen(ThreadPath(tid).c_str(), "rb");
+    if (in == NULL || fseek(in, sizeof(trace_header_t), SEEK_SET) != 0) return FALSE;
+
+    vector< char > buf(1 << 20);
+    UINT64 left = PaddedBytes(tid);
+    while (left > 0)
+    {
+        size_t n = left < buf.size() ? left : buf.size();
+        if (fread(buf.data(), 1, n, in) != n || fwrite(buf.data(), 1, n, out) != n)
+        {
+            fclose(in);
+            return FALSE;
+        }
+        left -= n;
+    }
+    fclose(in);
+    return remove(ThreadPath(tid).c_str()) == 0;
+}
+
+// Write the profile of every thread
+static VOID WriteProfiles()
+{
+    FILE* out = fopen(KnobProfile.Value().c_str(), "w");
+    if (out == NULL)
+    {
+        fprintf(stderr, "pinatrace: cannot open %s\n", KnobProfile.Value().c_str());
+        return;
+    }
+
+    profileWriteHeader(out, KnobLine.Value(), KnobWindow.Value());
+    for (THREADID tid = 0; tid < files.size(); tid++)
+    {
+        if (!files[tid].used) continue;
+        profileWrite(out, tid, InstrCount(tid), files[tid].profile);
+        delete files[tid].profile;
+    }
+    if (fclose(out) != 0)
+    {
+        fprintf(stderr, "pinatrace: cannot write %s\n", KnobProfile.Value().c_str());
+    }
 }
 
 VOID Fini(INT32 code, VOID* v)
 {
-    fprintf(trace, "#eof\n");
-    fclose(trace);
+    UINT64 dataEnd = sizeof(trace_header_t);
+
+    // Buffers handed over after the writer stopped, e.g. the last partial
+    // buffer of each thread still running at exit
+    vector< trace_access_t > records;
+    vector< UINT8 > packed;
+    while (!fullBuffers.empty())
+    {
+        WriteBuffer(fullBuffers.front(), records, packed);
+        fullBuffers.pop_front();
+    }
+
+    if (!KnobProfile.Value().empty()) WriteProfiles();
+    if (!KnobTrace) return;
+
+    // Complete every thread file: pending repeat, padding to keep the index
+    // aligned, index after its accesses, header patched
+    for (THREADID tid = 0; tid < files.size(); tid++)
+    {
+        thread_file_t& f = files[tid];
+        if (!f.used) continue;
+
+        BOOL ok = TRUE;
+        if (KnobCompress)
+        {
+            packed.clear();
+            encoderFinish(&f.encoder, packed);
+            ok = WriteData(f, packed.data(), packed.size());
+        }
+        static const UINT8 zeros[8] = {0};
+        size_t pad = PaddedBytes(tid) - f.bytes;
+
+        // The header is patched last, so a failed file still reads as empty
+        trace_index_t entry = ThreadEntry(tid, sizeof(trace_header_t));
+        ok = ok && fwrite(zeros, 1, pad, f.fptr) == pad && fwrite(&entry, sizeof(entry), 1, f.fptr) == 1 &&
+             fseek(f.fptr, 0, SEEK_SET) == 0 && WriteHeader(f.fptr, 1, sizeof(trace_header_t) + PaddedBytes(tid));
+        if (fclose(f.fptr) != 0 || !ok)
+        {
+            fprintf(stderr, "pinatrace: cannot write %s\n", ThreadPath(tid).c_str());
+            return;
+        }
+    }
+
+    if (KnobSplit) return;
+
+    // Merge them into one indexed trace
+    FILE* out = fopen(KnobOutput.Value().c_str(), "wb");
+    if (out == NULL)
+    {
+        fprintf(stderr, "pinatrace: cannot open %s\n", KnobOutput.Value().c_str());
+        return;
+    }
+    if (!WriteHeader(out, 0, 0))
+    {
+        fprintf(stderr, "pinatrace: cannot write %s\n", KnobOutput.Value().c_str());
+        fclose(out);
+        return;
+    }
+
+    vector< trace_index_t > index;
+    for (THREADID tid = 0; tid < files.size(); tid++)
+    {
+        if (!files[tid].used) continue;
+        if (!CopyAccesses(tid, out))
+        {
+            fprintf(stderr, "pinatrace: cannot merge %s\n", ThreadPath(tid).c_str());
+            fclose(out);
+            return;
+        }
+        index.push_back(ThreadEntry(tid, dataEnd));
+        dataEnd += PaddedBytes(tid);
+    }
+
+    BOOL ok = fwrite(index.data(), sizeof(trace_index_t), index.size(), out) == index.size() &&
+              fseek(out, 0, SEEK_SET) == 0 && WriteHeader(out, index.size(), dataEnd);
+    if (fclose(out) != 0 || !ok)
+    {
+        fprintf(stderr, "pinatrace: cannot write %s\n", KnobOutput.Value().c_str());
+    }
 }
 
 /* ===================================================================== */
@@ -156,7 +631,7 @@ VOID Fini(INT32 code, VOID* v)
 
 INT32 Usage()
 {
-    PIN_ERROR("This Pintool prints a trace of memory addresses\n" + KNOB_BASE::StringKnobSummary() + "\n");
+    PIN_ERROR("This Pintool writes a binary trace of memory accesses\n" + KNOB_BASE::StringKnobSummary() + "\n");
     return -1;
 }
 
@@ -168,22 +643,56 @@ int main(int argc, char* argv[])
 {
     if (PIN_Init(argc, argv)) return Usage();
 
-    // Obtain  a key for TLS storage.
-    tls_key = PIN_CreateThreadDataKey(NULL);
-    if (tls_key == INVALID_TLS_KEY)
+    // Per-thread instruction count, kept in a register for the inline fills
+    countReg = PIN_ClaimToolRegister();
+    memReg = PIN_ClaimToolRegister();
+    if (!REG_valid(countReg) || !REG_valid(memReg))
     {
-        printf("number of already allocated keys reached the MAX_CLIENT_TLS_KEYS limit\n");
+        printf("Cannot allocate a scratch register\n");
         PIN_ExitProcess(1);
     }
 
-    trace = fopen("pinatrace.out", "w");
+    if ((KnobLine.Value() & (KnobLine.Value() - 1)) != 0 || KnobLine.Value() == 0)
+    {
+        printf("-line must be a power of two\n");
+        PIN_ExitProcess(1);
+    }
 
-    // Initiate Lock for File access
-    PIN_InitLock(&globalLock);
+    if (KnobPeriod.Value() && (KnobSample.Value() == 0 || KnobSample.Value() > KnobPeriod.Value()))
+    {
+        printf("-sample must be between 1 and -period\n");
+        PIN_ExitProcess(1);
+    }
+    skipCount = KnobSkip.Value();
+    lengthCount = KnobLength.Value();
+    sampleCount = KnobSample.Value();
+    periodCount = KnobPeriod.Value();
+    sampling = skipCount || lengthCount || periodCount;
+
+    // Routine names for -region
+    if (!KnobRegion.Value().empty()) PIN_InitSymbols();
+
+    // Fixed-size per-thread buffers
+    bufId = PIN_DefineTraceBuffer(sizeof(buffer_record_t), KnobPages.Value(), BufferFull, 0);
+    if (bufId == BUFFER_ID_INVALID)
+    {
+        printf("Cannot allocate the trace buffers\n");
+        PIN_ExitProcess(1);
+    }
+
+    PIN_InitLock(&queueLock);
+    PIN_InitLock(&countLock);
+    PIN_SemaphoreInit(&fullSem);
+    PIN_SemaphoreInit(&freeSem);
+
+    // Writer thread, drains full buffers while the application runs
+    if (PIN_SpawnInternalThread(WriterThread, NULL, 0, &writerUid) == INVALID_THREADID)
+    {
+        printf("Cannot start the writer thread\n");
+        PIN_ExitProcess(1);
+    }
 
-    // Register Instruction to be called to instrument instructions.
-    // This is for detecting memory accesses
-    INS_AddInstrumentFunction(Instruction, 0);
+    PIN_AddPrepareForFiniFunction(PrepareForFini, 0);
     PIN_AddFiniFunction(Fini, 0);
 
     // Register ThreadStart to be called when a thread starts.
@@ -193,7 +702,7 @@ int main(int argc, char* argv[])
     PIN_AddThreadFiniFunction(ThreadFini, NULL);
 
     // Register Trace to be called to instrument blocks.
-    // This is for counting Instructions
+    // This is for counting Instructions and recording memory accesses
     TRACE_AddInstrumentFunction(Trace, NULL);
 
     // Never returns
@@ -5,9 +5,13 @@ from greedy import GreedyScheduler
 from algo2 import HFPScheduler
 from algo3 import HFPHeterScheduler
 from copy import deepcopy
+import ast
+import sys
 
 
-f = open("pinatrace_mm.out", "r")
+# a memory trace, or a task profile written by the pin tool (-profile) or by
+# tracecvt -p, which lists each task's cache lines instead of every address
+f = open(sys.argv[1] if len(sys.argv) > 1 else "pinatrace_mm.out", "r")
 content = f.read()
 lines = content.split('\n')
 
@@ -16,17 +20,31 @@ time_est = {}
 data = {}
 
 for l in lines:
-    if l == "#eof":
+    if l == "#eof" or l == "":
         break
+    if l.startswith('#'):
+        continue
+    if lines[0].startswith('# profile'):
+        # (tid, instr_count, accesses, footprint, working_set, [reuse], [(first line, lines), ...])
+        line_size = int(lines[0].split()[3])
+        (thread_id, time, _, _, _, _, runs) = ast.literal_eval(l)
+        read = [first + i * line_size for (first, n) in runs for i in range(n)]
+        threads.append((thread_id, time, read))
+        time_est[thread_id] = time
+        data[thread_id] = deepcopy(read)
+        continue
     l = l.strip('(')
     l = l.strip(')')
     tmp1 = l.split('[')
-    read = tmp1[1].split(']')[0].split(',')
-    for r in range(len(read)):
-        read[r] = int(read[r])
-    write = tmp1[2].split(']')[0].split(',')
-    for w in range(len(write)):
-        write[w] = int(write[w])
+    if len(tmp1) == 2:
+        # ordered format: [(op, addr, size, icount_delta[, ip]), ...], op 0 = read
+        accesses = [[int(x) for x in a.split(',') if x.strip()]
+                    for a in tmp1[1].replace(']', '').replace('(', '').split(')') if a.strip(', ')]
+        read = [a[1] for a in accesses if a[0] == 0]
+        write = [a[1] for a in accesses if a[0] == 1]
+    else:
+        read = [int(r) for r in tmp1[1].split(']')[0].split(',') if r.strip()]
+        write = [int(w) for w in tmp1[2].split(']')[0].split(',') if w.strip()]
     thread_id = int(tmp1[0].split(',')[0])
     time = int(tmp1[0].split(',')[1])
     read.extend(write)